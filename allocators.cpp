@@ -0,0 +1,290 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "counters.h"
+#include "threads.h"
+
+/*****************************************************************************
+ * ALLOCATORS
+ *
+ * malloc/free and new/delete under a few common allocation patterns, across
+ * size classes from 16 B to 1 MiB and from one thread up to the number of
+ * hardware threads. Configure with -DBENCHMARKS_ALLOCATOR=jemalloc (or
+ * tcmalloc, mimalloc, auto) to run the same benchmarks against a different
+ * malloc. The label on each result says which allocator was linked in.
+ *
+ * These don't count allocations: counting is a shared atomic update and a
+ * malloc_usable_size call on every operator new, which would slow NewDelete
+ * down next to MallocFree and serialize the threads on the counters. The
+ * counting build still replaces operator new/delete with ones that call
+ * malloc/free, though, so NewDelete only measures an allocator's own
+ * operator new/delete when built with -DBENCHMARKS_COUNT_ALLOCATIONS=OFF.
+ *****************************************************************************/
+
+#ifndef BENCHMARKS_ALLOCATOR_NAME
+#define BENCHMARKS_ALLOCATOR_NAME "system"
+#endif
+
+namespace {
+
+struct MallocFree {
+    static void* allocate(std::size_t size) { return std::malloc(size); }
+    static void deallocate(void* ptr) { std::free(ptr); }
+};
+
+struct NewDelete {
+    static void* allocate(std::size_t size) { return new char[size]; }
+    static void deallocate(void* ptr) { delete[] static_cast<char*>(ptr); }
+};
+
+// Number of allocations each thread performs per benchmark iteration, and how
+// many blocks it holds on to at once.
+const auto kNumAllocationsPerThread = 1 << 14;
+const auto kNumLiveBlocks = 64;
+
+template <typename Allocator>
+void* allocateAndTouch(std::size_t size) {
+    // Write to the block so the allocator can't hand back memory that's
+    // never been faulted in, and so the compiler can't elide the pair.
+    auto ptr = static_cast<char*>(Allocator::allocate(size));
+    ptr[0] = 1;
+    benchmark::DoNotOptimize(ptr);
+    return ptr;
+}
+
+/**
+ * Single-producer single-consumer ring buffer used to hand blocks from the
+ * thread that allocated them to the thread that frees them.
+ */
+class SpscQueue {
+   public:
+    bool tryPush(void* ptr) {
+        auto tail = _tail.load(std::memory_order_relaxed);
+        auto next = (tail + 1) % kCapacity;
+        if (next == _head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        _slots[tail] = ptr;
+        _tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(void*& ptr) {
+        auto head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        ptr = _slots[head];
+        _head.store((head + 1) % kCapacity, std::memory_order_release);
+        return true;
+    }
+
+   private:
+    static constexpr std::size_t kCapacity = 256;
+
+    std::array<void*, kCapacity> _slots;
+    alignas(128) std::atomic<std::size_t> _head{0};
+    alignas(128) std::atomic<std::size_t> _tail{0};
+};
+
+}  // namespace
+
+/**
+ * Allocates a batch of blocks and frees them in reverse order, which is the
+ * best case for allocators that keep LIFO free lists.
+ */
+template <typename Allocator>
+static void BM_allocLIFO(benchmark::State& state) {
+    const std::size_t size = state.range(0);
+    const int numThreads = state.range(1);
+
+    WorkerThreads workers(numThreads);
+    BenchmarkCounters counters(state, /*countAllocations=*/false);
+    for (auto _ : state) {
+        state.SetIterationTime(workers.run([&](int) {
+            std::array<void*, kNumLiveBlocks> blocks;
+            for (auto n = 0; n < kNumAllocationsPerThread;
+                 n += kNumLiveBlocks) {
+                for (auto& block : blocks) {
+                    block = allocateAndTouch<Allocator>(size);
+                }
+                for (auto i = kNumLiveBlocks - 1; i >= 0; --i) {
+                    Allocator::deallocate(blocks[i]);
+                }
+            }
+        }));
+    }
+    counters.stop();
+
+    state.SetItemsProcessed(state.iterations() * numThreads *
+                            kNumAllocationsPerThread);
+    state.SetLabel(BENCHMARKS_ALLOCATOR_NAME);
+}
+
+/**
+ * Allocates a batch of blocks and frees them in allocation order.
+ */
+template <typename Allocator>
+static void BM_allocFIFO(benchmark::State& state) {
+    const std::size_t size = state.range(0);
+    const int numThreads = state.range(1);
+
+    WorkerThreads workers(numThreads);
+    BenchmarkCounters counters(state, /*countAllocations=*/false);
+    for (auto _ : state) {
+        state.SetIterationTime(workers.run([&](int) {
+            std::array<void*, kNumLiveBlocks> blocks;
+            for (auto n = 0; n < kNumAllocationsPerThread;
+                 n += kNumLiveBlocks) {
+                for (auto& block : blocks) {
+                    block = allocateAndTouch<Allocator>(size);
+                }
+                for (auto block : blocks) {
+                    Allocator::deallocate(block);
+                }
+            }
+        }));
+    }
+    counters.stop();
+
+    state.SetItemsProcessed(state.iterations() * numThreads *
+                            kNumAllocationsPerThread);
+    state.SetLabel(BENCHMARKS_ALLOCATOR_NAME);
+}
+
+/**
+ * Keeps a pool of live blocks and repeatedly replaces a randomly chosen one,
+ * so that block lifetimes are random and the heap gets fragmented.
+ */
+template <typename Allocator>
+static void BM_allocRandomLifetime(benchmark::State& state) {
+    const std::size_t size = state.range(0);
+    const int numThreads = state.range(1);
+
+    // Generate the victim sequences up front so the RNG isn't timed.
+    std::vector<std::vector<std::uint8_t>> victims(numThreads);
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> dist(0, kNumLiveBlocks - 1);
+    for (auto& sequence : victims) {
+        sequence.resize(kNumAllocationsPerThread);
+        std::generate(sequence.begin(), sequence.end(),
+                      [&] { return dist(gen); });
+    }
+
+    WorkerThreads workers(numThreads);
+    BenchmarkCounters counters(state, /*countAllocations=*/false);
+    for (auto _ : state) {
+        state.SetIterationTime(workers.run([&](int t) {
+            std::array<void*, kNumLiveBlocks> blocks;
+            for (auto& block : blocks) {
+                block = allocateAndTouch<Allocator>(size);
+            }
+            for (auto victim : victims[t]) {
+                Allocator::deallocate(blocks[victim]);
+                blocks[victim] = allocateAndTouch<Allocator>(size);
+            }
+            for (auto block : blocks) {
+                Allocator::deallocate(block);
+            }
+        }));
+    }
+    counters.stop();
+
+    state.SetItemsProcessed(state.iterations() * numThreads *
+                            kNumAllocationsPerThread);
+    state.SetLabel(BENCHMARKS_ALLOCATOR_NAME);
+}
+
+/**
+ * Pairs of threads where the producer allocates every block and the consumer
+ * frees it. Allocators with thread-local caches have to send these blocks
+ * back to the owning thread (or arena) somehow, and that's what this
+ * measures.
+ */
+template <typename Allocator>
+static void BM_allocCrossThreadFree(benchmark::State& state) {
+    const std::size_t size = state.range(0);
+    const int numThreads = state.range(1);
+    const int numPairs = numThreads / 2;
+
+    WorkerThreads workers(numThreads);
+    BenchmarkCounters counters(state, /*countAllocations=*/false);
+    for (auto _ : state) {
+        std::vector<SpscQueue> queues(numPairs);
+        state.SetIterationTime(workers.run([&](int t) {
+            auto& queue = queues[t / 2];
+            if (t % 2 == 0) {
+                for (auto n = 0; n < kNumAllocationsPerThread; ++n) {
+                    auto block = allocateAndTouch<Allocator>(size);
+                    while (!queue.tryPush(block)) {
+                        std::this_thread::yield();
+                    }
+                }
+            } else {
+                for (auto n = 0; n < kNumAllocationsPerThread; ++n) {
+                    void* block;
+                    while (!queue.tryPop(block)) {
+                        std::this_thread::yield();
+                    }
+                    Allocator::deallocate(block);
+                }
+            }
+        }));
+    }
+    counters.stop();
+
+    state.SetItemsProcessed(state.iterations() * numPairs *
+                            kNumAllocationsPerThread);
+    state.SetLabel(BENCHMARKS_ALLOCATOR_NAME);
+}
+
+static void allocatorArguments(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"size", "threads"});
+    for (auto size = 16; size <= 1 << 20; size *= 4) {
+        for (auto threads : threadCounts(1, 1)) {
+            b->Args({size, threads});
+        }
+    }
+}
+
+static void crossThreadAllocatorArguments(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"size", "threads"});
+    for (auto size = 16; size <= 1 << 20; size *= 4) {
+        // Threads come in producer/consumer pairs.
+        for (auto threads : threadCounts(2, 2)) {
+            b->Args({size, threads});
+        }
+    }
+}
+
+BENCHMARK_TEMPLATE(BM_allocLIFO, MallocFree)
+    ->Apply(allocatorArguments)
+    ->UseManualTime();
+BENCHMARK_TEMPLATE(BM_allocLIFO, NewDelete)
+    ->Apply(allocatorArguments)
+    ->UseManualTime();
+BENCHMARK_TEMPLATE(BM_allocFIFO, MallocFree)
+    ->Apply(allocatorArguments)
+    ->UseManualTime();
+BENCHMARK_TEMPLATE(BM_allocFIFO, NewDelete)
+    ->Apply(allocatorArguments)
+    ->UseManualTime();
+BENCHMARK_TEMPLATE(BM_allocRandomLifetime, MallocFree)
+    ->Apply(allocatorArguments)
+    ->UseManualTime();
+BENCHMARK_TEMPLATE(BM_allocRandomLifetime, NewDelete)
+    ->Apply(allocatorArguments)
+    ->UseManualTime();
+BENCHMARK_TEMPLATE(BM_allocCrossThreadFree, MallocFree)
+    ->Apply(crossThreadAllocatorArguments)
+    ->UseManualTime();
+BENCHMARK_TEMPLATE(BM_allocCrossThreadFree, NewDelete)
+    ->Apply(crossThreadAllocatorArguments)
+    ->UseManualTime();
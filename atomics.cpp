@@ -0,0 +1,270 @@
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "counters.h"
+#include "threads.h"
+
+/*****************************************************************************
+ * ATOMIC OPERATIONS AND MEMORY ORDERING
+ *
+ * BM_useAtomic only does seq_cst ++counter. Here every read-modify-write
+ * (fetch_add, exchange and a compare-exchange loop) runs with relaxed,
+ * acq_rel and seq_cst ordering on 32- and 64-bit words, and so do loads and
+ * stores, alone and with a separate atomic_thread_fence. On x86 every RMW is
+ * a locked instruction whatever the ordering, so they should all cost the
+ * same, and the orderings only matter for stores, where seq_cst is an xchg
+ * (or a mov and an mfence) instead of a plain mov. On aarch64 acquire and
+ * release map to different instructions (ldar/stlr, or the ordered forms of
+ * the LSE atomics), so weaker orderings can be cheaper. 128-bit
+ * compare-exchange (cmpxchg16b) is run where the CPU has it.
+ *
+ * threads is how many threads run at once. With shared_word:1 they all hit
+ * one word, so RMWs and stores fight over its cache line (loads just share
+ * it); with shared_word:0 each thread has its own word on its own cache
+ * line, which is the uncontended cost of the same instructions.
+ *****************************************************************************/
+
+namespace {
+
+constexpr auto kRelaxed = std::memory_order_relaxed;
+constexpr auto kAcquire = std::memory_order_acquire;
+constexpr auto kRelease = std::memory_order_release;
+constexpr auto kAcqRel = std::memory_order_acq_rel;
+constexpr auto kSeqCst = std::memory_order_seq_cst;
+
+// Each operation is a stateful functor, constructed once per thread and
+// called on the thread's word once per operation.
+
+template <typename T, std::memory_order kOrder>
+struct FetchAdd {
+    using Word = std::atomic<T>;
+    void operator()(Word& word) {
+        benchmark::DoNotOptimize(word.fetch_add(1, kOrder));
+    }
+};
+
+template <typename T, std::memory_order kOrder>
+struct Exchange {
+    using Word = std::atomic<T>;
+    void operator()(Word& word) {
+        benchmark::DoNotOptimize(word.exchange(++_value, kOrder));
+    }
+
+    T _value = 0;
+};
+
+/**
+ * Increment with a compare-exchange loop, the way lock-free code does
+ * anything that isn't a single fetch_add.
+ */
+template <typename T, std::memory_order kOrder>
+struct CasLoop {
+    using Word = std::atomic<T>;
+    void operator()(Word& word) {
+        auto expected = word.load(kRelaxed);
+        // The failure ordering can't be release or acq_rel.
+        while (!word.compare_exchange_weak(expected, expected + 1, kOrder,
+                                           kRelaxed)) {
+        }
+    }
+};
+
+template <typename T, std::memory_order kOrder>
+struct Load {
+    using Word = std::atomic<T>;
+    void operator()(Word& word) {
+        benchmark::DoNotOptimize(word.load(kOrder));
+    }
+};
+
+template <typename T, std::memory_order kOrder>
+struct Store {
+    using Word = std::atomic<T>;
+    void operator()(Word& word) { word.store(++_value, kOrder); }
+
+    T _value = 0;
+};
+
+/**
+ * A relaxed load followed by a fence, which is how code that reads several
+ * atomics and only then synchronizes is written.
+ */
+template <typename T, std::memory_order kFence>
+struct FencedLoad {
+    using Word = std::atomic<T>;
+    void operator()(Word& word) {
+        benchmark::DoNotOptimize(word.load(kRelaxed));
+        std::atomic_thread_fence(kFence);
+    }
+};
+
+/**
+ * A relaxed store with a fence: a release fence goes before the store, and a
+ * seq_cst fence after it, where it keeps the store from being reordered
+ * with later loads (as in Dekker's algorithm).
+ */
+template <typename T, std::memory_order kFence>
+struct FencedStore {
+    using Word = std::atomic<T>;
+    void operator()(Word& word) {
+        if (kFence == kRelease) {
+            std::atomic_thread_fence(kFence);
+            word.store(++_value, kRelaxed);
+        } else {
+            word.store(++_value, kRelaxed);
+            std::atomic_thread_fence(kFence);
+        }
+    }
+
+    T _value = 0;
+};
+
+#if defined(__x86_64__) && defined(__SIZEOF_INT128__)
+
+#define BENCHMARKS_DOUBLE_WIDTH_CAS 1
+
+using Uint128 = unsigned __int128;
+
+[[gnu::target("cx16")]] Uint128 compareAndSwap128(Uint128* word,
+                                                  Uint128 expected,
+                                                  Uint128 desired) {
+    return __sync_val_compare_and_swap(word, expected, desired);
+}
+
+/**
+ * Increment of a 16-byte word with cmpxchg16b, which lock-free stacks and
+ * queues use to update a pointer and a counter together. There's no 128-bit
+ * load that's guaranteed to be atomic, so the loop starts from the value the
+ * previous compare-exchange saw; with no other thread writing the word that
+ * is always current, and the loop is a single cmpxchg16b. It's always a
+ * full barrier, so there are no weaker orderings to compare it with.
+ */
+struct DoubleWidthCasLoop {
+    struct alignas(16) Word {
+        Uint128 value = 0;
+    };
+
+    void operator()(Word& word) {
+        while (true) {
+            auto seen = compareAndSwap128(&word.value, _expected,
+                                          _expected + 1);
+            if (seen == _expected) {
+                _expected = seen + 1;
+                return;
+            }
+            _expected = seen;
+        }
+    }
+
+    Uint128 _expected = 0;
+};
+
+bool hasDoubleWidthCas() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("cmpxchg16b");
+}
+
+#endif
+
+template <typename Op>
+bool isSupported() {
+    return true;
+}
+
+#ifdef BENCHMARKS_DOUBLE_WIDTH_CAS
+template <>
+bool isSupported<DoubleWidthCasLoop>() {
+    return hasDoubleWidthCas();
+}
+#endif
+
+const std::int64_t kNumAtomicOperationsPerThread = 1 << 16;
+
+}  // namespace
+
+template <typename Op>
+static void BM_atomic(benchmark::State& state) {
+    const int numThreads = state.range(0);
+    const bool sharedWord = state.range(1);
+    if (!isSupported<Op>()) {
+        state.SkipWithError("Not supported on this CPU");
+        return;
+    }
+
+    struct alignas(128) PaddedWord {
+        typename Op::Word word{};
+    };
+    std::vector<PaddedWord> words(sharedWord ? 1 : numThreads);
+
+    WorkerThreads workers(numThreads);
+    BenchmarkCounters counters(state);
+    for (auto _ : state) {
+        state.SetIterationTime(workers.run([&](int t) {
+            auto& word = words[sharedWord ? 0 : t].word;
+            Op op;
+            for (std::int64_t i = 0; i < kNumAtomicOperationsPerThread; ++i) {
+                op(word);
+            }
+        }));
+    }
+    counters.stop();
+
+    setThroughputCounters(state, kNumAtomicOperationsPerThread * numThreads,
+                          numThreads);
+}
+
+static void atomicArguments(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"threads", "shared_word"});
+    for (auto threads : threadCounts()) {
+        b->Args({threads, 1});
+        if (threads > 1) {
+            b->Args({threads, 0});
+        }
+    }
+}
+
+#define BENCHMARK_ATOMIC(...)                  \
+    BENCHMARK_TEMPLATE(BM_atomic, __VA_ARGS__) \
+        ->Apply(atomicArguments)               \
+        ->UseManualTime()
+
+BENCHMARK_ATOMIC(FetchAdd<std::uint32_t, kRelaxed>);
+BENCHMARK_ATOMIC(FetchAdd<std::uint32_t, kAcqRel>);
+BENCHMARK_ATOMIC(FetchAdd<std::uint32_t, kSeqCst>);
+BENCHMARK_ATOMIC(FetchAdd<std::uint64_t, kRelaxed>);
+BENCHMARK_ATOMIC(FetchAdd<std::uint64_t, kAcqRel>);
+BENCHMARK_ATOMIC(FetchAdd<std::uint64_t, kSeqCst>);
+BENCHMARK_ATOMIC(Exchange<std::uint32_t, kRelaxed>);
+BENCHMARK_ATOMIC(Exchange<std::uint32_t, kAcqRel>);
+BENCHMARK_ATOMIC(Exchange<std::uint32_t, kSeqCst>);
+BENCHMARK_ATOMIC(Exchange<std::uint64_t, kRelaxed>);
+BENCHMARK_ATOMIC(Exchange<std::uint64_t, kAcqRel>);
+BENCHMARK_ATOMIC(Exchange<std::uint64_t, kSeqCst>);
+BENCHMARK_ATOMIC(CasLoop<std::uint32_t, kRelaxed>);
+BENCHMARK_ATOMIC(CasLoop<std::uint32_t, kAcqRel>);
+BENCHMARK_ATOMIC(CasLoop<std::uint32_t, kSeqCst>);
+BENCHMARK_ATOMIC(CasLoop<std::uint64_t, kRelaxed>);
+BENCHMARK_ATOMIC(CasLoop<std::uint64_t, kAcqRel>);
+BENCHMARK_ATOMIC(CasLoop<std::uint64_t, kSeqCst>);
+#ifdef BENCHMARKS_DOUBLE_WIDTH_CAS
+BENCHMARK_ATOMIC(DoubleWidthCasLoop);
+#endif
+BENCHMARK_ATOMIC(Load<std::uint32_t, kRelaxed>);
+BENCHMARK_ATOMIC(Load<std::uint32_t, kAcquire>);
+BENCHMARK_ATOMIC(Load<std::uint32_t, kSeqCst>);
+BENCHMARK_ATOMIC(Load<std::uint64_t, kRelaxed>);
+BENCHMARK_ATOMIC(Load<std::uint64_t, kAcquire>);
+BENCHMARK_ATOMIC(Load<std::uint64_t, kSeqCst>);
+BENCHMARK_ATOMIC(FencedLoad<std::uint64_t, kAcquire>);
+BENCHMARK_ATOMIC(FencedLoad<std::uint64_t, kSeqCst>);
+BENCHMARK_ATOMIC(Store<std::uint32_t, kRelaxed>);
+BENCHMARK_ATOMIC(Store<std::uint32_t, kRelease>);
+BENCHMARK_ATOMIC(Store<std::uint32_t, kSeqCst>);
+BENCHMARK_ATOMIC(Store<std::uint64_t, kRelaxed>);
+BENCHMARK_ATOMIC(Store<std::uint64_t, kRelease>);
+BENCHMARK_ATOMIC(Store<std::uint64_t, kSeqCst>);
+BENCHMARK_ATOMIC(FencedStore<std::uint64_t, kRelease>);
+BENCHMARK_ATOMIC(FencedStore<std::uint64_t, kSeqCst>);
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+
+#include "spin.h"
+
+/**
+ * Simple barrier based on busy-waiting. It can be reused: once every thread
+ * has arrived, the count starts over for the next round.
+ */
+class Barrier {
+   public:
+    Barrier(int numTotalThreads) : _numTotalThreads(numTotalThreads) {}
+
+    void arriveAndWait() {
+        // Read the round before arriving, since the last thread to arrive
+        // moves it on.
+        const auto round = _round.load();
+        if (++_numThreadsArrived == _numTotalThreads) {
+            _numThreadsArrived = 0;
+            ++_round;
+        } else {
+            while (_round.load() == round) {
+            }
+        }
+    }
+
+   private:
+    std::atomic_int32_t _numThreadsArrived{0};
+    std::atomic_int32_t _round{0};
+    int _numTotalThreads;
+};
+
+/**
+ * Reusable sense-reversing barrier: a counter, plus a sense flag on its own
+ * cache line that flips when the last thread arrives, so waiters only read a
+ * line that changes once per round. Waiters pause with exponential backoff,
+ * and yield once they've waited a while, so this one still behaves when
+ * there are more threads than CPUs.
+ */
+class BackoffBarrier {
+   public:
+    explicit BackoffBarrier(int numTotalThreads)
+        : _numTotalThreads(numTotalThreads) {}
+
+    void arriveAndWait() {
+        // The sense can't flip until this thread arrives, so this is the
+        // current one, and the barrier opens when it flips.
+        const bool sense = !_sense.load(std::memory_order_acquire);
+        if (_numThreadsArrived.fetch_add(1, std::memory_order_acq_rel) + 1 ==
+            _numTotalThreads) {
+            _numThreadsArrived.store(0, std::memory_order_relaxed);
+            _sense.store(sense, std::memory_order_release);
+        } else {
+            Backoff backoff;
+            while (_sense.load(std::memory_order_acquire) != sense) {
+                backoff.pause();
+            }
+        }
+    }
+
+   private:
+    alignas(64) std::atomic_int32_t _numThreadsArrived{0};
+    alignas(64) std::atomic<bool> _sense{false};
+    const int _numTotalThreads;
+};
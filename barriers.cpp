@@ -0,0 +1,221 @@
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <ctime>
+#include <vector>
+
+#if __has_include(<barrier>)
+#include <barrier>
+#endif
+
+#include "barrier.h"
+#include "counters.h"
+#include "futex.h"
+#include "spin.h"
+#include "threads.h"
+
+/*****************************************************************************
+ * BARRIERS
+ *
+ * Every thread goes through the same barrier kNumBarrierRounds times, which
+ * is what a bulk-synchronous program does between phases. The barriers are:
+ *  - spin: the Barrier the other benchmarks use, every thread spinning on
+ *    one counter as hard as it can
+ *  - senseReversing: BackoffBarrier, a counter plus a sense flag on its own
+ *    cache line, so waiters only read a line that changes once per round,
+ *    with pause and exponential backoff while they wait
+ *  - futex: waiters sleep in the kernel until the last thread wakes them
+ *  - dissemination: log2(N) rounds of pairwise signals, so no cache line is
+ *    written by more than one thread per round
+ *  - std: C++20 std::barrier, when the compiler has it
+ *
+ * Each reports ns_per_barrier, the wall-clock time per barrier, and
+ * cpu_ns_per_barrier, the CPU time all the threads together burned per
+ * barrier, which is where spinning and sleeping differ the most.
+ *****************************************************************************/
+
+namespace {
+
+const int kNumBarrierRounds = 1'000;
+
+// The barriers from barrier.h, with the interface the others have.
+
+class SpinBarrier {
+   public:
+    explicit SpinBarrier(int numThreads) : _barrier(numThreads) {}
+
+    void arriveAndWait(int) { _barrier.arriveAndWait(); }
+
+   private:
+    Barrier _barrier;
+};
+
+class SenseReversingBarrier {
+   public:
+    explicit SenseReversingBarrier(int numThreads) : _barrier(numThreads) {}
+
+    void arriveAndWait(int) { _barrier.arriveAndWait(); }
+
+   private:
+    BackoffBarrier _barrier;
+};
+
+#ifdef BENCHMARKS_FUTEX
+
+class FutexBarrier {
+   public:
+    explicit FutexBarrier(int numThreads) : _numThreads(numThreads) {}
+
+    void arriveAndWait(int) {
+        const auto round = _round.load(std::memory_order_acquire);
+        if (_numArrived.fetch_add(1, std::memory_order_acq_rel) + 1 ==
+            _numThreads) {
+            _numArrived.store(0, std::memory_order_relaxed);
+            _round.fetch_add(1, std::memory_order_release);
+            futexWake(_round, INT_MAX);
+        } else {
+            while (_round.load(std::memory_order_acquire) == round) {
+                futexWait(_round, round);
+            }
+        }
+    }
+
+   private:
+    alignas(64) std::atomic<int> _numArrived{0};
+    alignas(64) std::atomic<std::uint32_t> _round{0};
+    const int _numThreads;
+};
+
+#endif
+
+/**
+ * In round k, thread t signals thread t + 2^k and waits for thread t - 2^k
+ * (mod N). After ceil(log2(N)) rounds every thread has heard, indirectly,
+ * from every other one. Signals are counted rather than flipped, so a thread
+ * that has already moved on to the next barrier can't be confused with one
+ * that's still in this one.
+ */
+class DisseminationBarrier {
+   public:
+    explicit DisseminationBarrier(int numThreads)
+        : _numThreads(numThreads), _threads(numThreads) {
+        while ((1 << _numRounds) < numThreads) {
+            ++_numRounds;
+        }
+    }
+
+    void arriveAndWait(int threadIndex) {
+        auto& self = _threads[threadIndex];
+        const auto epoch = ++self.epoch;
+        for (int round = 0, distance = 1; round < _numRounds;
+             ++round, distance *= 2) {
+            auto& partner = _threads[(threadIndex + distance) % _numThreads];
+            partner.signals[round].fetch_add(1, std::memory_order_release);
+            Backoff backoff;
+            while (self.signals[round].load(std::memory_order_acquire) <
+                   epoch) {
+                backoff.pause();
+            }
+        }
+    }
+
+   private:
+    static constexpr int kMaxRounds = 31;
+
+    // Everything one thread waits on, on its own cache lines.
+    struct alignas(128) PerThread {
+        std::atomic<std::uint32_t> signals[kMaxRounds]{};
+        // Only touched by the owning thread.
+        std::uint32_t epoch{0};
+    };
+
+    const int _numThreads;
+    int _numRounds{0};
+    std::vector<PerThread> _threads;
+};
+
+#if defined(__cpp_lib_barrier)
+
+class StdBarrier {
+   public:
+    explicit StdBarrier(int numThreads) : _barrier(numThreads) {}
+
+    void arriveAndWait(int) { _barrier.arrive_and_wait(); }
+
+   private:
+    std::barrier<> _barrier;
+};
+
+#endif
+
+double threadCpuSeconds() {
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+}  // namespace
+
+template <typename BarrierType>
+static void BM_barrier(benchmark::State& state) {
+    const int numThreads = state.range(0);
+    BarrierType barrier(numThreads);
+
+    struct alignas(128) CpuTime {
+        double seconds{0};
+    };
+    std::vector<CpuTime> cpuTimes(numThreads);
+    double seconds = 0;
+
+    WorkerThreads workers(numThreads);
+    BenchmarkCounters counters(state);
+    for (auto _ : state) {
+        const auto elapsed = workers.run([&](int t) {
+            const auto start = threadCpuSeconds();
+            for (auto round = 0; round < kNumBarrierRounds; ++round) {
+                barrier.arriveAndWait(t);
+            }
+            cpuTimes[t].seconds += threadCpuSeconds() - start;
+        });
+        state.SetIterationTime(elapsed);
+        seconds += elapsed;
+    }
+    counters.stop();
+
+    double cpuSeconds = 0;
+    for (const auto& cpuTime : cpuTimes) {
+        cpuSeconds += cpuTime.seconds;
+    }
+    const double numBarriers = state.iterations() * kNumBarrierRounds;
+    state.counters["ns_per_barrier"] = seconds * 1e9 / numBarriers;
+    state.counters["cpu_ns_per_barrier"] = cpuSeconds * 1e9 / numBarriers;
+}
+
+static void barrierArguments(benchmark::internal::Benchmark* b) {
+    b->ArgName("threads");
+    for (auto threads : threadCounts(2)) {
+        b->Arg(threads);
+    }
+}
+
+BENCHMARK_TEMPLATE(BM_barrier, SpinBarrier)
+    ->Apply(barrierArguments)
+    ->UseManualTime();
+BENCHMARK_TEMPLATE(BM_barrier, SenseReversingBarrier)
+    ->Apply(barrierArguments)
+    ->UseManualTime();
+#ifdef BENCHMARKS_FUTEX
+BENCHMARK_TEMPLATE(BM_barrier, FutexBarrier)
+    ->Apply(barrierArguments)
+    ->UseManualTime();
+#endif
+BENCHMARK_TEMPLATE(BM_barrier, DisseminationBarrier)
+    ->Apply(barrierArguments)
+    ->UseManualTime();
+#if defined(__cpp_lib_barrier)
+BENCHMARK_TEMPLATE(BM_barrier, StdBarrier)
+    ->Apply(barrierArguments)
+    ->UseManualTime();
+#endif
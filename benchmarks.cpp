@@ -1,4 +1,3 @@
-
 #include <benchmark/benchmark.h>
 
 #include <atomic>
@@ -7,9 +6,19 @@
 #include <list>
 #include <memory>
 #include <mutex>
+#include <random>
 #include <thread>
 #include <vector>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "cache_info.h"
+#include "cold_cache.h"
+#include "counters.h"
+#include "threads.h"
+
 /*****************************************************************************
  * FUNCTION CALL OVERHEAD
  *****************************************************************************/
@@ -51,6 +60,7 @@ class StandaloneInline {
 
 void BM_virtualFunctionCallsThroughPointerToParent(benchmark::State& state) {
     std::unique_ptr<Parent> parent = std::make_unique<Child>();
+    BenchmarkCounters counters(state);
     for (auto _ : state) {
         parent->increment();
         benchmark::DoNotOptimize(parent->get());
@@ -59,6 +69,7 @@ void BM_virtualFunctionCallsThroughPointerToParent(benchmark::State& state) {
 
 void BM_virtualFunctionCallsThroughPointerToChild(benchmark::State& state) {
     std::unique_ptr<Child> child = std::make_unique<Child>();
+    BenchmarkCounters counters(state);
     for (auto _ : state) {
         child->increment();
         benchmark::DoNotOptimize(child->get());
@@ -67,6 +78,7 @@ void BM_virtualFunctionCallsThroughPointerToChild(benchmark::State& state) {
 
 void BM_virtualFunctionCallsThroughInstanceOfChild(benchmark::State& state) {
     Child child;
+    BenchmarkCounters counters(state);
     for (auto _ : state) {
         child.increment();
         benchmark::DoNotOptimize(child.get());
@@ -75,6 +87,7 @@ void BM_virtualFunctionCallsThroughInstanceOfChild(benchmark::State& state) {
 
 void BM_nonVirtualNonInlineFunctionCall(benchmark::State& state) {
     StandaloneNoInline obj;
+    BenchmarkCounters counters(state);
     for (auto _ : state) {
         obj.increment();
         benchmark::DoNotOptimize(obj.get());
@@ -83,6 +96,7 @@ void BM_nonVirtualNonInlineFunctionCall(benchmark::State& state) {
 
 void BM_inlineFunctionCall(benchmark::State& state) {
     StandaloneInline obj;
+    BenchmarkCounters counters(state);
     for (auto _ : state) {
         obj.increment();
         benchmark::DoNotOptimize(obj.get());
@@ -91,6 +105,7 @@ void BM_inlineFunctionCall(benchmark::State& state) {
 
 void BM_noFunctionCall(benchmark::State& state) {
     int i = 0;
+    BenchmarkCounters counters(state);
     for (auto _ : state) {
         ++i;
         benchmark::DoNotOptimize(i);
@@ -100,6 +115,7 @@ void BM_noFunctionCall(benchmark::State& state) {
 void BM_stdFunctionCall(benchmark::State& state) {
     int i = 0;
     std::function<void()> fn = [&i]() { ++i; };
+    BenchmarkCounters counters(state);
     for (auto _ : state) {
         fn();
         benchmark::DoNotOptimize(i);
@@ -109,6 +125,7 @@ void BM_stdFunctionCall(benchmark::State& state) {
 void BM_lambdaFunctionCall(benchmark::State& state) {
     int i = 0;
     auto fn = [&i]() { ++i; };
+    BenchmarkCounters counters(state);
     for (auto _ : state) {
         fn();
         benchmark::DoNotOptimize(i);
@@ -125,6 +142,7 @@ void functionThatCallsFunction(std::function<void()>&& callable) { callable(); }
 void BM_stdFunctionPassedAsParameterFunctionCall(benchmark::State& state) {
     int i = 0;
     auto fn = [&i]() { ++i; };
+    BenchmarkCounters counters(state);
     for (auto _ : state) {
         functionThatCallsFunction([&i]() { ++i; });
         benchmark::DoNotOptimize(i);
@@ -134,64 +152,212 @@ void BM_stdFunctionPassedAsParameterFunctionCall(benchmark::State& state) {
 void BM_lambdaPassedAsParameterFunctionCall(benchmark::State& state) {
     int i = 0;
     auto fn = [&i]() { ++i; };
+    BenchmarkCounters counters(state);
     for (auto _ : state) {
         functionThatCallsLambda([&i]() { ++i; });
         benchmark::DoNotOptimize(i);
     }
 }
 
+/*****************************************************************************
+ * BRANCH PREDICTION
+ *
+ * Sums the elements of an array that are at or above a threshold. Values are
+ * sorted, so the branch is taken for the second half of the array and the
+ * predictor gets it right nearly every time, except that a percentage of the
+ * elements is replaced with random values, whose outcome can't be predicted.
+ * At 100% about half the branches are mispredicted.
+ *
+ * Compares an ordinary branch, a branchless scalar version that turns the
+ * comparison into a mask, and an SSE2 version that does the same four
+ * elements at a time.
+ *****************************************************************************/
+
+using ThresholdSumKernel = std::int64_t (*)(const std::int32_t*, std::size_t,
+                                            std::int32_t);
+
+[[gnu::noinline]] std::int64_t sumAboveThresholdBranchy(
+    const std::int32_t* data, std::size_t n, std::int32_t threshold) {
+    std::int64_t sum = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        if (data[i] >= threshold) {
+            // The compiler can't run a volatile asm statement when the
+            // condition is false, so it can't turn the branch into a
+            // conditional move or vectorize the loop, with any compiler or
+            // flags.
+            asm volatile("");
+            sum += data[i];
+        }
+    }
+    return sum;
+}
+
+// gnu::optimize is GCC only, hence the pragma for clang.
+[[gnu::noinline, gnu::optimize("no-tree-vectorize")]] std::int64_t
+sumAboveThresholdBranchless(const std::int32_t* data, std::size_t n,
+                            std::int32_t threshold) {
+    std::int64_t sum = 0;
+#ifdef __clang__
+#pragma clang loop vectorize(disable)
+#endif
+    for (std::size_t i = 0; i < n; ++i) {
+        // All ones if the element is at or above the threshold, else zero.
+        const std::int32_t mask =
+            -static_cast<std::int32_t>(data[i] >= threshold);
+        sum += data[i] & mask;
+    }
+    return sum;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+[[gnu::noinline]] std::int64_t sumAboveThresholdSimd(const std::int32_t* data,
+                                                     std::size_t n,
+                                                     std::int32_t threshold) {
+    const __m128i limit = _mm_set1_epi32(threshold - 1);
+    __m128i acc = _mm_setzero_si128();
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128i x =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        acc = _mm_add_epi32(acc, _mm_and_si128(x, _mm_cmpgt_epi32(x, limit)));
+    }
+    alignas(16) std::int32_t lanes[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), acc);
+
+    std::int64_t sum = std::int64_t{lanes[0]} + lanes[1] + lanes[2] + lanes[3];
+    for (; i < n; ++i) {
+        sum += data[i] >= threshold ? data[i] : 0;
+    }
+    return sum;
+}
+#endif
+
+static void BM_sumAboveThreshold(benchmark::State& state,
+                                 ThresholdSumKernel kernel) {
+    constexpr int k = 1 << 16;
+    constexpr std::int32_t kThreshold = 128;
+    const int randomPercent = state.range(0);
+
+    // Sorted values in [0, 256), with randomPercent of them replaced by
+    // random values in the same range.
+    std::vector<std::int32_t> arr(k);
+    for (auto i = 0; i < k; ++i) {
+        arr[i] = i * 256 / k;
+    }
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<std::int32_t> value(0, 255);
+    std::uniform_int_distribution<int> percent(0, 99);
+    for (auto& x : arr) {
+        if (percent(gen) < randomPercent) {
+            x = value(gen);
+        }
+    }
+
+    BenchmarkCounters counters(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(kernel(arr.data(), k, kThreshold));
+    }
+    counters.stop();
+
+    state.SetItemsProcessed(state.iterations() * k);
+}
+
+static void branchPredictabilityArguments(benchmark::internal::Benchmark* b) {
+    b->ArgName("random_pct");
+    for (auto percent : {0, 1, 5, 10, 25, 50, 100}) {
+        b->Arg(percent);
+    }
+}
+
 /*****************************************************************************
  * CACHE MISSES
  *
  * TODO: These assume L1 cache of 32K or smaller. See if we can make this more
  *       portable.
+ *
+ * These are templated on the element type, from 1-byte integers up to
+ * doubles. Narrower types fit more elements in each cache line (and in each
+ * SIMD register), so comparing bytes/s across types shows how much
+ * shrinking the elements buys at each level of the cache. Note that the float
+ * and double sums are one long dependency chain the compiler isn't allowed to
+ * reorder, so they're latency bound rather than memory bound (see
+ * reductions.h).
+ *
+ * Each one also runs cold, with its data flushed from the cache before every
+ * iteration (see cold_cache.h).
  *****************************************************************************/
 
+template <typename T, typename CacheMode>
 static void BM_sequentialListAccess(benchmark::State& state) {
     constexpr int k = 1024;
-    std::list<std::uint32_t> arr;
+    std::list<T> arr;
 
     for (auto i = 0; i < k; ++i) {
-        arr.emplace_back(i);
+        arr.emplace_back(static_cast<T>(i));
     }
 
+    BenchmarkCounters counters(state);
     for (auto _ : state) {
-        std::uint32_t sum = 0;
+        evictIfCold<CacheMode>(counters, [&] {
+            for (const auto& x : arr) {
+                evictFromCache(&x, sizeof(x));
+            }
+        });
+        IterationTimer<CacheMode> timer(state);
+        T sum = 0;
         for (auto x : arr) {
             sum += x;
         }
         benchmark::DoNotOptimize(sum);
     }
+    counters.stop();
+
+    state.SetBytesProcessed(state.iterations() * k * sizeof(T));
 }
 
+template <typename T, typename CacheMode>
 static void BM_sequentialArrayAccess(benchmark::State& state) {
     constexpr int k = 1024;
-    std::vector<std::uint32_t> arr;
+    std::vector<T> arr;
 
     for (auto i = 0; i < k; ++i) {
-        arr.emplace_back(i);
+        arr.emplace_back(static_cast<T>(i));
     }
 
+    BenchmarkCounters counters(state);
     for (auto _ : state) {
-        std::uint32_t sum = 0;
+        evictIfCold<CacheMode>(counters, [&] {
+            evictFromCache(arr.data(), arr.size() * sizeof(T));
+        });
+        IterationTimer<CacheMode> timer(state);
+        T sum = 0;
         for (auto x : arr) {
             sum += x;
         }
         benchmark::DoNotOptimize(sum);
     }
+    counters.stop();
+
+    state.SetBytesProcessed(state.iterations() * k * sizeof(T));
 }
 
+template <typename T, typename CacheMode>
 static void BM_sequentialArrayAccessSmallerThanL1(benchmark::State& state) {
     constexpr int k = 32;
-    std::uint32_t arr[k][k];
+    T arr[k][k];
     for (auto i = 0; i < k; ++i) {
         for (auto j = 0; j < k; ++j) {
-            arr[j][i] = i * j;
+            arr[j][i] = static_cast<T>(i * j);
         }
     }
 
+    BenchmarkCounters counters(state);
     for (auto _ : state) {
-        std::uint32_t sum = 0;
+        evictIfCold<CacheMode>(counters, [&] {
+            evictFromCache(arr, sizeof(arr));
+        });
+        IterationTimer<CacheMode> timer(state);
+        T sum = 0;
         for (auto i = 0; i < k; ++i) {
             for (auto j = 0; j < k; ++j) {
                 // Row order traversal
@@ -200,19 +366,28 @@ static void BM_sequentialArrayAccessSmallerThanL1(benchmark::State& state) {
         }
         benchmark::DoNotOptimize(sum);
     }
+    counters.stop();
+
+    state.SetBytesProcessed(state.iterations() * k * k * sizeof(T));
 }
 
+template <typename T, typename CacheMode>
 static void BM_randomArrayAccessSmallerThanL1(benchmark::State& state) {
     constexpr int k = 32;
-    std::uint32_t arr[k][k];
+    T arr[k][k];
     for (auto i = 0; i < k; ++i) {
         for (auto j = 0; j < k; ++j) {
-            arr[j][i] = i * j;
+            arr[j][i] = static_cast<T>(i * j);
         }
     }
 
+    BenchmarkCounters counters(state);
     for (auto _ : state) {
-        std::uint32_t sum = 0;
+        evictIfCold<CacheMode>(counters, [&] {
+            evictFromCache(arr, sizeof(arr));
+        });
+        IterationTimer<CacheMode> timer(state);
+        T sum = 0;
         for (auto i = 0; i < k; ++i) {
             for (auto j = 0; j < k; ++j) {
                 // Column order traversal
@@ -221,19 +396,29 @@ static void BM_randomArrayAccessSmallerThanL1(benchmark::State& state) {
         }
         benchmark::DoNotOptimize(sum);
     }
+    counters.stop();
+
+    state.SetBytesProcessed(state.iterations() * k * k * sizeof(T));
 }
 
+template <typename T, typename CacheMode>
 static void BM_sequentialArrayAccessBiggerThanL1(benchmark::State& state) {
     constexpr int k = 1'024;
-    std::uint32_t arr[k][k];
+    // Too big for the stack once T is 8 bytes wide.
+    auto arr = std::make_unique<T[][k]>(k);
     for (auto i = 0; i < k; ++i) {
         for (auto j = 0; j < k; ++j) {
-            arr[i][j] = i * j;
+            arr[i][j] = static_cast<T>(i * j);
         }
     }
 
+    BenchmarkCounters counters(state);
     for (auto _ : state) {
-        std::uint32_t sum = 0;
+        evictIfCold<CacheMode>(counters, [&] {
+            evictFromCache(arr.get(), k * k * sizeof(T));
+        });
+        IterationTimer<CacheMode> timer(state);
+        T sum = 0;
         for (auto i = 0; i < k; ++i) {
             for (auto j = 0; j < k; ++j) {
                 // Row order traversal
@@ -242,19 +427,29 @@ static void BM_sequentialArrayAccessBiggerThanL1(benchmark::State& state) {
         }
         benchmark::DoNotOptimize(sum);
     }
+    counters.stop();
+
+    state.SetBytesProcessed(state.iterations() * k * k * sizeof(T));
 }
 
+template <typename T, typename CacheMode>
 static void BM_randomArrayAccessBiggerThanL1(benchmark::State& state) {
     constexpr int k = 1'024;
-    std::uint32_t arr[k][k];
+    // Too big for the stack once T is 8 bytes wide.
+    auto arr = std::make_unique<T[][k]>(k);
     for (auto i = 0; i < k; ++i) {
         for (auto j = 0; j < k; ++j) {
-            arr[i][j] = i * j;
+            arr[i][j] = static_cast<T>(i * j);
         }
     }
 
+    BenchmarkCounters counters(state);
     for (auto _ : state) {
-        std::uint32_t sum = 0;
+        evictIfCold<CacheMode>(counters, [&] {
+            evictFromCache(arr.get(), k * k * sizeof(T));
+        });
+        IterationTimer<CacheMode> timer(state);
+        T sum = 0;
         for (auto i = 0; i < k; ++i) {
             for (auto j = 0; j < k; ++j) {
                 // Column order traversal
@@ -263,206 +458,136 @@ static void BM_randomArrayAccessBiggerThanL1(benchmark::State& state) {
         }
         benchmark::DoNotOptimize(sum);
     }
+    counters.stop();
+
+    state.SetBytesProcessed(state.iterations() * k * k * sizeof(T));
 }
 
 /*****************************************************************************
  * FALSE SHARING
+ *
+ * This and the locking benchmarks take a placement argument as well as a
+ * thread count. Unpinned runs go from 1 thread up to every hardware thread;
+ * the pinned ones run two threads on a pair of CPUs with the given
+ * relationship (see topology.h), since the cost of moving a cache line
+ * between them depends on how much of the cache hierarchy they share.
  *****************************************************************************/
 
-/**
- * Simple barrier based on busy-waiting
- */
-class Barrier {
-   public:
-    Barrier(int numTotalThreads) : _numTotalThreads(numTotalThreads) {}
-
-    void arriveAndWait() {
-        ++_numThreadsArrived;
-        while (_numThreadsArrived < _numTotalThreads) {
-        }
-    }
-
-   private:
-    std::atomic_int32_t _numThreadsArrived{0};
-    int _numTotalThreads;
-};
-
+// Split between however many threads the benchmark runs with.
 const auto kNumIterationsFalseSharing = 1000000;
 
-static void BM_falseSharing(benchmark::State& state) {
-    // Both of these will end up on the same cache line.
-    // TODO: This isn't guaranteed. Make this better.
-    struct Counter {
-        std::uint32_t val{0};
-    } counterA, counterB;
-
-    for (auto _ : state) {
-        Barrier barrier(3);
-
-        std::thread a([&] {
-            barrier.arriveAndWait();
-            for (auto i = 0; i < kNumIterationsFalseSharing; ++i)
-                benchmark::DoNotOptimize(++counterA.val);
-        });
-        std::thread b([&] {
-            barrier.arriveAndWait();
-            for (auto i = 0; i < kNumIterationsFalseSharing; ++i)
-                benchmark::DoNotOptimize(++counterB.val);
-        });
+// Largest distance between two threads' counters, and the alignment of the
+// buffer they live in, so the first one always starts a cache line (and a
+// pair of them, for the adjacent line prefetcher).
+const std::size_t kMaxFalseSharingDistance = 256;
 
-        barrier.arriveAndWait();
-        auto start = std::chrono::high_resolution_clock::now();
-        a.join();
-        b.join();
-        auto end = std::chrono::high_resolution_clock::now();
-
-        auto elapsed_seconds =
-            std::chrono::duration_cast<std::chrono::duration<double>>(end -
-                                                                      start);
-
-        state.SetIterationTime(elapsed_seconds.count());
+/**
+ * Each thread increments its own counter, placed `distance` bytes after the
+ * previous thread's in the same buffer. Below the cache line size the
+ * counters share lines, and each line bounces between the cores that use it
+ * on every increment.
+ */
+static void BM_falseSharing(benchmark::State& state) {
+    const std::size_t distance = state.range(0);
+    const int numThreads = state.range(1);
+    const auto cpus = benchmarkPlacementCpus(state, 2);
+    if (state.error_occurred()) {
+        return;
     }
-}
-
-static void BM_noFalseSharing(benchmark::State& state) {
-    // Align the struct at cache line boundaries.
-    struct alignas(128) Counter {
-        std::uint32_t val{0};
-    } counterA, counterB;
-
+    struct alignas(kMaxFalseSharingDistance) Chunk {
+        unsigned char bytes[kMaxFalseSharingDistance]{};
+    };
+    std::vector<Chunk> buffer(numThreads);
+    auto bytes = reinterpret_cast<unsigned char*>(buffer.data());
+    const auto iterationsPerThread = kNumIterationsFalseSharing / numThreads;
+
+    WorkerThreads workers(numThreads, cpus);
+    BenchmarkCounters counters(state);
     for (auto _ : state) {
-        Barrier barrier(3);
-        std::thread a([&] {
-            barrier.arriveAndWait();
+        state.SetIterationTime(workers.run([&](int t) {
+            auto counter =
+                reinterpret_cast<std::uint32_t*>(bytes + t * distance);
+            for (auto i = 0; i < iterationsPerThread; ++i)
+                benchmark::DoNotOptimize(++*counter);
+        }));
+    }
+    counters.stop();
 
-            for (auto i = 0; i < kNumIterationsFalseSharing; ++i)
-                benchmark::DoNotOptimize(++counterA.val);
-        });
-        std::thread b([&] {
-            barrier.arriveAndWait();
+    setThroughputCounters(state, iterationsPerThread * numThreads, numThreads);
+    state.counters["cache_line"] = cacheLineSize();
+    state.counters["interference_size"] = destructiveInterferenceSize();
+}
 
-            for (auto i = 0; i < kNumIterationsFalseSharing; ++i)
-                benchmark::DoNotOptimize(++counterB.val);
+static void falseSharingArguments(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"distance", "threads", "placement"});
+    for (auto distance = sizeof(std::uint32_t);
+         distance <= kMaxFalseSharingDistance; distance *= 2) {
+        forEachThreadPlacement([&](int threads, int placement) {
+            b->Args({static_cast<int>(distance), threads, placement});
         });
-        barrier.arriveAndWait();
-        auto start = std::chrono::high_resolution_clock::now();
-        a.join();
-        b.join();
-        auto end = std::chrono::high_resolution_clock::now();
-
-        auto elapsed_seconds =
-            std::chrono::duration_cast<std::chrono::duration<double>>(end -
-                                                                      start);
-
-        state.SetIterationTime(elapsed_seconds.count());
     }
 }
 
 /*****************************************************************************
  * LOCKING VS. ATOMICS
+ *
+ * These run with 1 to hardware_concurrency() threads, or two pinned ones
+ * like the false sharing benchmark, which split kNumIterationsMutex
+ * increments between them, and report the throughput of all the threads
+ * together and of each one.
  *****************************************************************************/
 
 const auto kNumIterationsMutex = 1000000;
 
 static void BM_useMutex(benchmark::State& state) {
+    const int numThreads = state.range(0);
+    const auto iterationsPerThread = kNumIterationsMutex / numThreads;
+    const auto cpus = benchmarkPlacementCpus(state, 1);
+    if (state.error_occurred()) {
+        return;
+    }
     std::mutex mtx;
     std::uint32_t counter{0};
+    WorkerThreads workers(numThreads, cpus);
+    BenchmarkCounters counters(state);
     for (auto _ : state) {
-        Barrier barrier(3);
-        std::thread a([&] {
-            barrier.arriveAndWait();
-            for (auto i = 0; i < kNumIterationsMutex; ++i) {
+        state.SetIterationTime(workers.run([&](int) {
+            for (auto i = 0; i < iterationsPerThread; ++i) {
                 std::lock_guard lk(mtx);
                 benchmark::DoNotOptimize(++counter);
             }
-        });
-        std::thread b([&] {
-            barrier.arriveAndWait();
-            for (auto i = 0; i < kNumIterationsMutex; ++i) {
-                std::lock_guard lk(mtx);
-                benchmark::DoNotOptimize(++counter);
-            }
-        });
-
-        barrier.arriveAndWait();
-        auto start = std::chrono::high_resolution_clock::now();
-        a.join();
-        b.join();
-        auto end = std::chrono::high_resolution_clock::now();
-
-        auto elapsed_seconds =
-            std::chrono::duration_cast<std::chrono::duration<double>>(end -
-                                                                      start);
-
-        state.SetIterationTime(elapsed_seconds.count());
+        }));
     }
-}
-
-// TODO: This benchmark is suspect and doesn't really compare to the previous
-// one. Figure out something better.
-static void BM_useMutexNoContention(benchmark::State& state) {
-    for (auto _ : state) {
-        Barrier barrier(2);
-        std::thread a([&] {
-            barrier.arriveAndWait();
-            std::mutex mtx;
-            std::uint32_t counter{0};
-            for (auto i = 0; i < kNumIterationsMutex; ++i) {
-                std::lock_guard lk(mtx);
-                benchmark::DoNotOptimize(++counter);
-            }
-        });
-        std::thread b([&] {
-            barrier.arriveAndWait();
-            std::mutex mtx;
-            std::uint32_t counter{0};
-            for (auto i = 0; i < kNumIterationsMutex; ++i) {
-                std::lock_guard lk(mtx);
-                benchmark::DoNotOptimize(++counter);
-            }
-        });
-        barrier.arriveAndWait();
-        auto start = std::chrono::high_resolution_clock::now();
-        a.join();
-        b.join();
-        auto end = std::chrono::high_resolution_clock::now();
-
-        auto elapsed_seconds =
-            std::chrono::duration_cast<std::chrono::duration<double>>(end -
-                                                                      start);
+    counters.stop();
 
-        state.SetIterationTime(elapsed_seconds.count());
-    }
+    setThroughputCounters(state, iterationsPerThread * numThreads, numThreads);
 }
 
 static void BM_useAtomic(benchmark::State& state) {
+    const int numThreads = state.range(0);
+    const auto iterationsPerThread = kNumIterationsMutex / numThreads;
+    const auto cpus = benchmarkPlacementCpus(state, 1);
+    if (state.error_occurred()) {
+        return;
+    }
+    WorkerThreads workers(numThreads, cpus);
+    BenchmarkCounters counters(state);
     for (auto _ : state) {
         std::atomic_int32_t counter{0};
-
-        Barrier barrier(2);
-        std::thread a([&] {
-            barrier.arriveAndWait();
-            for (auto i = 0; i < kNumIterationsMutex; ++i) {
+        state.SetIterationTime(workers.run([&](int) {
+            for (auto i = 0; i < iterationsPerThread; ++i)
                 benchmark::DoNotOptimize(++counter);
-            }
-        });
-        std::thread b([&] {
-            barrier.arriveAndWait();
-            for (auto i = 0; i < kNumIterationsMutex; ++i)
-                benchmark::DoNotOptimize(++counter);
-        });
-        barrier.arriveAndWait();
-        auto start = std::chrono::high_resolution_clock::now();
-        a.join();
-        b.join();
-        auto end = std::chrono::high_resolution_clock::now();
+        }));
+    }
+    counters.stop();
 
-        auto elapsed_seconds =
-            std::chrono::duration_cast<std::chrono::duration<double>>(end -
-                                                                      start);
+    setThroughputCounters(state, iterationsPerThread * numThreads, numThreads);
+}
 
-        state.SetIterationTime(elapsed_seconds.count());
-    }
+static void threadScalingArguments(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"threads", "placement"});
+    forEachThreadPlacement(
+        [&](int threads, int placement) { b->Args({threads, placement}); });
 }
 
 BENCHMARK(BM_virtualFunctionCallsThroughPointerToParent);
@@ -477,20 +602,42 @@ BENCHMARK(BM_lambdaFunctionCall);
 BENCHMARK(BM_stdFunctionPassedAsParameterFunctionCall);
 BENCHMARK(BM_lambdaPassedAsParameterFunctionCall);
 
-BENCHMARK(BM_sequentialListAccess);
-BENCHMARK(BM_sequentialArrayAccess);
-
-BENCHMARK(BM_sequentialArrayAccessSmallerThanL1);
-BENCHMARK(BM_randomArrayAccessSmallerThanL1);
-
-BENCHMARK(BM_sequentialArrayAccessBiggerThanL1);
-BENCHMARK(BM_randomArrayAccessBiggerThanL1);
-
-BENCHMARK(BM_falseSharing)->UseManualTime();
-BENCHMARK(BM_noFalseSharing)->UseManualTime();
-
-BENCHMARK(BM_useMutex)->UseManualTime();
-BENCHMARK(BM_useMutexNoContention)->UseManualTime();
-BENCHMARK(BM_useAtomic)->UseManualTime();
+BENCHMARK_CAPTURE(BM_sumAboveThreshold, branchy, sumAboveThresholdBranchy)
+    ->Apply(branchPredictabilityArguments);
+BENCHMARK_CAPTURE(BM_sumAboveThreshold, branchless,
+                  sumAboveThresholdBranchless)
+    ->Apply(branchPredictabilityArguments);
+#if defined(__x86_64__) || defined(__i386__)
+BENCHMARK_CAPTURE(BM_sumAboveThreshold, simd, sumAboveThresholdSimd)
+    ->Apply(branchPredictabilityArguments);
+#endif
+
+#define BENCHMARK_ELEMENT_TYPES(fn)                               \
+    BENCHMARK_TEMPLATE(fn, std::uint8_t, Hot);                    \
+    BENCHMARK_TEMPLATE(fn, std::uint8_t, Cold)->UseManualTime();  \
+    BENCHMARK_TEMPLATE(fn, std::uint16_t, Hot);                   \
+    BENCHMARK_TEMPLATE(fn, std::uint16_t, Cold)->UseManualTime(); \
+    BENCHMARK_TEMPLATE(fn, std::uint32_t, Hot);                   \
+    BENCHMARK_TEMPLATE(fn, std::uint32_t, Cold)->UseManualTime(); \
+    BENCHMARK_TEMPLATE(fn, std::uint64_t, Hot);                   \
+    BENCHMARK_TEMPLATE(fn, std::uint64_t, Cold)->UseManualTime(); \
+    BENCHMARK_TEMPLATE(fn, float, Hot);                           \
+    BENCHMARK_TEMPLATE(fn, float, Cold)->UseManualTime();         \
+    BENCHMARK_TEMPLATE(fn, double, Hot);                          \
+    BENCHMARK_TEMPLATE(fn, double, Cold)->UseManualTime()
+
+BENCHMARK_ELEMENT_TYPES(BM_sequentialListAccess);
+BENCHMARK_ELEMENT_TYPES(BM_sequentialArrayAccess);
+
+BENCHMARK_ELEMENT_TYPES(BM_sequentialArrayAccessSmallerThanL1);
+BENCHMARK_ELEMENT_TYPES(BM_randomArrayAccessSmallerThanL1);
+
+BENCHMARK_ELEMENT_TYPES(BM_sequentialArrayAccessBiggerThanL1);
+BENCHMARK_ELEMENT_TYPES(BM_randomArrayAccessBiggerThanL1);
+
+BENCHMARK(BM_falseSharing)->Apply(falseSharingArguments)->UseManualTime();
+
+BENCHMARK(BM_useMutex)->Apply(threadScalingArguments)->UseManualTime();
+BENCHMARK(BM_useAtomic)->Apply(threadScalingArguments)->UseManualTime();
 
 BENCHMARK_MAIN();
@@ -0,0 +1,38 @@
+#include "cache_info.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <new>
+
+#if defined(__unix__)
+#include <unistd.h>
+#endif
+
+std::size_t lastLevelCacheSize() {
+    std::size_t size = 0;
+    for (const auto& cache : benchmark::CPUInfo::Get().caches) {
+        if (cache.type != "Instruction") {
+            size = std::max<std::size_t>(size, cache.size);
+        }
+    }
+    return size ? size : 32 << 20;
+}
+
+std::size_t cacheLineSize() {
+#if defined(_SC_LEVEL1_DCACHE_LINESIZE)
+    const auto size = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+    if (size > 0) {
+        return size;
+    }
+#endif
+    return 64;
+}
+
+std::size_t destructiveInterferenceSize() {
+#if defined(__cpp_lib_hardware_interference_size)
+    return std::hardware_destructive_interference_size;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+ * Size in bytes of the largest data or unified cache google benchmark found
+ * on this machine, or a guess if it didn't find any.
+ */
+std::size_t lastLevelCacheSize();
+
+/**
+ * Size in bytes of an L1 data cache line, as reported by the OS, or 64 if it
+ * doesn't say.
+ */
+std::size_t cacheLineSize();
+
+/**
+ * std::hardware_destructive_interference_size, i.e. the padding the compiler
+ * recommends to keep two objects from sharing a cache line, or 0 if the
+ * standard library doesn't provide it.
+ */
+std::size_t destructiveInterferenceSize();
@@ -0,0 +1,34 @@
+#include "cold_cache.h"
+
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BENCHMARKS_X86 1
+#endif
+
+#include "cache_info.h"
+
+void evictFromCache(const void* data, std::size_t bytes) {
+#ifdef BENCHMARKS_X86
+    static const std::uintptr_t lineSize = cacheLineSize();
+    auto line = reinterpret_cast<std::uintptr_t>(data) & ~(lineSize - 1);
+    const auto end = reinterpret_cast<std::uintptr_t>(data) + bytes;
+    for (; line < end; line += lineSize) {
+        _mm_clflush(reinterpret_cast<const void*>(line));
+    }
+    _mm_mfence();
+#else
+    evictAllCaches();
+#endif
+}
+
+void evictAllCaches() {
+    static std::vector<std::uint8_t> buffer(2 * lastLevelCacheSize());
+    static const std::size_t lineSize = cacheLineSize();
+    for (std::size_t i = 0; i < buffer.size(); i += lineSize) {
+        ++buffer[i];
+    }
+    benchmark::ClobberMemory();
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <cstddef>
+#include <type_traits>
+
+#include "counters.h"
+
+/*****************************************************************************
+ * COLD CACHES
+ *
+ * Benchmarks that loop over the same data run with it in cache after the
+ * first iteration, which is rarely how that data is seen in a real program.
+ * Templating a benchmark on one of these tags and calling evictIfCold() at
+ * the top of each iteration gives a hot and a cold version of it:
+ *
+ *     template <typename CacheMode>
+ *     static void BM_something(benchmark::State& state) {
+ *         ...
+ *         BenchmarkCounters counters(state);
+ *         for (auto _ : state) {
+ *             evictIfCold<CacheMode>(counters, [&] {
+ *                 evictFromCache(data.data(), data.size());
+ *             });
+ *             IterationTimer<CacheMode> timer(state);
+ *             ...
+ *         }
+ *     }
+ *
+ *     BENCHMARK_TEMPLATE(BM_something, Hot);
+ *     BENCHMARK_TEMPLATE(BM_something, Cold)->UseManualTime();
+ *
+ * Eviction happens outside the timed part of the iteration, with the
+ * hardware counters paused. Cold benchmarks use manual time rather than
+ * state.PauseTiming(), which costs more than a short iteration itself and
+ * would skew it. Hot ones keep the library's own timing of the whole loop,
+ * since two clock reads per iteration are still tens of ns. Eviction costs
+ * far more than most iterations do, so cold benchmarks take a lot longer to
+ * run than their hot counterparts.
+ *****************************************************************************/
+
+struct Hot {};
+struct Cold {};
+
+/**
+ * Flushes every cache line in [data, data + bytes) out of every level of the
+ * cache with clflush. Falls back to evictAllCaches() where clflush isn't
+ * available.
+ */
+void evictFromCache(const void* data, std::size_t bytes);
+
+/**
+ * Evicts everything by reading and writing a buffer twice the size of the
+ * last level cache. For when the working set isn't known or isn't
+ * contiguous.
+ */
+void evictAllCaches();
+
+template <typename CacheMode, typename Evict>
+void evictIfCold(BenchmarkCounters& counters, Evict&& evict) {
+    if constexpr (std::is_same_v<CacheMode, Cold>) {
+        counters.pause();
+        evict();
+        counters.resume();
+    }
+}
+
+/**
+ * For Cold, sets the manual time of the current iteration to how long this
+ * was alive. For Hot, does nothing.
+ */
+template <typename CacheMode>
+class IterationTimer {
+   public:
+    explicit IterationTimer(benchmark::State& state) : _state(state) {
+        if constexpr (kTimed) {
+            _start = Clock::now();
+        }
+    }
+
+    ~IterationTimer() {
+        if constexpr (kTimed) {
+            const auto end = Clock::now();
+            _state.SetIterationTime(
+                std::chrono::duration_cast<std::chrono::duration<double>>(
+                    end - _start)
+                    .count());
+        }
+    }
+
+    IterationTimer(const IterationTimer&) = delete;
+    IterationTimer& operator=(const IterationTimer&) = delete;
+
+   private:
+    using Clock = std::chrono::high_resolution_clock;
+    static constexpr bool kTimed = std::is_same_v<CacheMode, Cold>;
+
+    benchmark::State& _state;
+    Clock::time_point _start;
+};
@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include "topology.h"
+
+/*****************************************************************************
+ * CORE TO CORE LATENCY
+ *
+ * The false sharing benchmarks show that moving a cache line between cores
+ * costs something; this measures what it costs between every pair of CPUs.
+ * Two threads pinned to the pair take turns writing an atomic, each waiting
+ * to see the other's write before making its own, so every round trip moves
+ * the line there and back.
+ *
+ * The result is an N x N matrix of round-trip latencies in nanoseconds,
+ * printed as a table and a text heatmap, and optionally written as JSON:
+ *
+ *     ./bin/core_to_core_latency [--rounds N] [--json FILE]
+ *****************************************************************************/
+
+namespace {
+
+const int kDefaultRounds = 100'000;
+
+// Each pair is measured this many times and the fastest one kept, so that a
+// preemption or interrupt in the middle of one doesn't show up in the matrix.
+const int kSamplesPerPair = 3;
+
+/**
+ * Average round trip in nanoseconds between threads pinned to cpuA and cpuB.
+ */
+double measureRoundTrip(int cpuA, int cpuB, int rounds) {
+    alignas(64) std::atomic<int> flag{-1};
+
+    std::thread pong([&] {
+        pinThisThread(cpuB);
+        flag.store(0, std::memory_order_release);
+        for (auto round = 0; round < rounds; ++round) {
+            while (flag.load(std::memory_order_acquire) != 2 * round + 1) {
+            }
+            flag.store(2 * round + 2, std::memory_order_release);
+        }
+    });
+
+    pinThisThread(cpuA);
+    while (flag.load(std::memory_order_acquire) != 0) {
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (auto round = 0; round < rounds; ++round) {
+        flag.store(2 * round + 1, std::memory_order_release);
+        while (flag.load(std::memory_order_acquire) != 2 * round + 2) {
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    pong.join();
+
+    return std::chrono::duration<double, std::nano>(end - start).count() /
+           rounds;
+}
+
+using Matrix = std::vector<std::vector<double>>;
+
+// Marks the diagonal, which isn't measured.
+const double kNotMeasured = -1;
+
+Matrix measureAllPairs(const std::vector<int>& cpus, int rounds) {
+    Matrix matrix(cpus.size(), std::vector<double>(cpus.size(), kNotMeasured));
+    for (std::size_t i = 0; i < cpus.size(); ++i) {
+        for (std::size_t j = i + 1; j < cpus.size(); ++j) {
+            auto best = std::numeric_limits<double>::max();
+            for (auto sample = 0; sample < kSamplesPerPair; ++sample) {
+                best = std::min(best,
+                                measureRoundTrip(cpus[i], cpus[j], rounds));
+            }
+            // A round trip is the same in both directions.
+            matrix[i][j] = matrix[j][i] = best;
+        }
+    }
+    return matrix;
+}
+
+void printTable(std::ostream& out, const std::vector<int>& cpus,
+                const Matrix& matrix) {
+    out << "Round trip latency (ns)\n" << std::setw(6) << "";
+    for (auto cpu : cpus) {
+        out << ' ' << std::setw(5) << cpu;
+    }
+    out << '\n';
+    for (std::size_t i = 0; i < cpus.size(); ++i) {
+        out << std::setw(6) << cpus[i];
+        for (auto latency : matrix[i]) {
+            if (latency == kNotMeasured) {
+                out << ' ' << std::setw(5) << "-";
+            } else {
+                out << ' ' << std::setw(5) << std::fixed
+                    << std::setprecision(0) << latency;
+            }
+        }
+        out << '\n';
+    }
+}
+
+/**
+ * One character per pair, darker for slower, scaled between the fastest and
+ * slowest pair, so groups of CPUs that share a cache stand out as blocks.
+ */
+void printHeatmap(std::ostream& out, const std::vector<int>& cpus,
+                  const Matrix& matrix) {
+    const char kShades[] = " .:-=+*#%@";
+    const auto kNumShades = sizeof(kShades) - 1;
+
+    auto lowest = std::numeric_limits<double>::max();
+    auto highest = 0.0;
+    for (const auto& row : matrix) {
+        for (auto latency : row) {
+            if (latency != kNotMeasured) {
+                lowest = std::min(lowest, latency);
+                highest = std::max(highest, latency);
+            }
+        }
+    }
+
+    out << "\nHeatmap (' ' = " << std::fixed << std::setprecision(0) << lowest
+        << " ns, '@' = " << highest << " ns)\n";
+    for (std::size_t i = 0; i < cpus.size(); ++i) {
+        out << std::setw(6) << cpus[i] << ' ';
+        for (auto latency : matrix[i]) {
+            if (latency == kNotMeasured) {
+                out << '\\';
+                continue;
+            }
+            const auto scaled =
+                highest > lowest ? (latency - lowest) / (highest - lowest) : 0;
+            out << kShades[std::min<std::size_t>(scaled * kNumShades,
+                                                 kNumShades - 1)];
+        }
+        out << '\n';
+    }
+}
+
+void writeJson(std::ostream& out, const std::vector<int>& cpus,
+               const Matrix& matrix) {
+    out << "{\n  \"cpus\": [";
+    for (std::size_t i = 0; i < cpus.size(); ++i) {
+        out << (i ? ", " : "") << cpus[i];
+    }
+    out << "],\n  \"round_trip_ns\": [\n";
+    for (std::size_t i = 0; i < cpus.size(); ++i) {
+        out << "    [";
+        for (std::size_t j = 0; j < cpus.size(); ++j) {
+            out << (j ? ", " : "");
+            if (matrix[i][j] == kNotMeasured) {
+                out << "null";
+            } else {
+                out << std::fixed << std::setprecision(1) << matrix[i][j];
+            }
+        }
+        out << (i + 1 < cpus.size() ? "],\n" : "]\n");
+    }
+    out << "  ]\n}\n";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    int rounds = kDefaultRounds;
+    const char* jsonPath = nullptr;
+    for (auto i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+            rounds = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--rounds N] [--json FILE]\n";
+            return 1;
+        }
+    }
+    if (rounds <= 0) {
+        std::cerr << "--rounds must be positive\n";
+        return 1;
+    }
+
+    std::vector<int> cpus;
+    for (const auto& location : cpuTopology()) {
+        cpus.push_back(location.cpu);
+    }
+    if (cpus.size() < 2) {
+        std::cerr << "Need at least two CPUs whose topology can be read\n";
+        return 1;
+    }
+
+    const auto matrix = measureAllPairs(cpus, rounds);
+    printTable(std::cout, cpus, matrix);
+    printHeatmap(std::cout, cpus, matrix);
+
+    if (jsonPath) {
+        std::ofstream json(jsonPath);
+        writeJson(json, cpus, matrix);
+        if (!json) {
+            std::cerr << "Couldn't write " << jsonPath << '\n';
+            return 1;
+        }
+    }
+    return 0;
+}
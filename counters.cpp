@@ -0,0 +1,444 @@
+#include "counters.h"
+
+#include <malloc.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+
+#ifdef BENCHMARKS_PERF_COUNTERS
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*****************************************************************************
+ * ALLOCATION COUNTING
+ *
+ * Replaces the global operator new/delete (and wraps malloc, calloc, realloc
+ * and free when built with BENCHMARKS_COUNT_MALLOC, via ld's --wrap) so that
+ * every allocation made while a BenchmarkCounters is counting bumps a few
+ * global counters. Sizes come from malloc_usable_size, so they include the
+ * allocator's rounding.
+ *
+ * The counters are shared atomics, which adds some contention to
+ * allocation-heavy multi-threaded benchmarks. The allocator benchmarks don't
+ * count, and outside of a benchmark's timed loop nothing is counted, so the
+ * only cost then is checking gCountingAllocations.
+ *****************************************************************************/
+
+namespace {
+
+std::atomic<bool> gCountingAllocations{false};
+std::atomic<std::int64_t> gNumAllocations{0};
+std::atomic<std::int64_t> gBytesAllocated{0};
+std::atomic<std::int64_t> gLiveBytes{0};
+std::atomic<std::int64_t> gPeakLiveBytes{0};
+
+[[maybe_unused]] bool countingAllocations() {
+    return gCountingAllocations.load(std::memory_order_relaxed);
+}
+
+[[maybe_unused]] void recordAllocation(void* ptr) {
+    if (!ptr || !countingAllocations()) {
+        return;
+    }
+    const std::int64_t size = malloc_usable_size(ptr);
+    gNumAllocations.fetch_add(1, std::memory_order_relaxed);
+    gBytesAllocated.fetch_add(size, std::memory_order_relaxed);
+
+    auto live = gLiveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    auto peak = gPeakLiveBytes.load(std::memory_order_relaxed);
+    while (live > peak && !gPeakLiveBytes.compare_exchange_weak(
+                              peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+[[maybe_unused]] void recordDeallocation(void* ptr) {
+    if (!ptr || !countingAllocations()) {
+        return;
+    }
+    const std::int64_t size = malloc_usable_size(ptr);
+    gLiveBytes.fetch_sub(size, std::memory_order_relaxed);
+}
+
+}  // namespace
+
+/*****************************************************************************
+ * HARDWARE COUNTERS
+ *
+ * One perf event per counter, opened for the main thread before main() runs
+ * with inherit set, so that every thread a benchmark starts is counted too,
+ * whether or not it was started before the benchmark's BenchmarkCounters.
+ * Reading, enabling and disabling an event applies to the copies the threads
+ * inherited as well, and a thread's counts are added to the event's when it
+ * exits. Resetting an event doesn't clear those, or the enabled and running
+ * times, so nothing is reset: each benchmark reads the events when it starts
+ * and reports the difference when it stops. Events are opened individually
+ * rather than as a group so that the kernel can multiplex them when there are
+ * more events than hardware counters; values are scaled by the fraction of
+ * the benchmark's time each event was actually running.
+ *
+ * If perf_event_open isn't permitted (see /proc/sys/kernel/perf_event_paranoid)
+ * or the PMU isn't exposed, e.g. in some VMs and containers, the counters that
+ * can't be opened just aren't reported.
+ *****************************************************************************/
+
+namespace {
+
+#ifdef BENCHMARKS_PERF_COUNTERS
+
+constexpr std::uint64_t cacheEvent(std::uint64_t cache, std::uint64_t op,
+                                   std::uint64_t result) {
+    return cache | (op << 8) | (result << 16);
+}
+
+struct PerfEvent {
+    const char* name;
+    std::uint32_t type;
+    std::uint64_t config;
+};
+
+const PerfEvent kPerfEvents[] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"l1d_misses", PERF_TYPE_HW_CACHE,
+     cacheEvent(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+                PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {"llc_misses", PERF_TYPE_HW_CACHE,
+     cacheEvent(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ,
+                PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"dtlb_misses", PERF_TYPE_HW_CACHE,
+     cacheEvent(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ,
+                PERF_COUNT_HW_CACHE_RESULT_MISS)},
+};
+
+class PerfCounters {
+   public:
+    static PerfCounters& get() {
+        static PerfCounters counters;
+        return counters;
+    }
+
+    void start() {
+        for (auto& counter : _counters) {
+            counter.started = readValues(counter.fd, counter.start);
+            ioctl(counter.fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    void pause() {
+        for (auto& counter : _counters) {
+            ioctl(counter.fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+
+    void resume() {
+        for (auto& counter : _counters) {
+            ioctl(counter.fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    void stop(benchmark::State& state) {
+        pause();
+        for (auto& counter : _counters) {
+            Values end;
+            if (!counter.started || !readValues(counter.fd, end)) {
+                continue;
+            }
+            const auto value = end[0] - counter.start[0];
+            const auto enabled = end[1] - counter.start[1];
+            const auto running = end[2] - counter.start[2];
+            if (running == 0) {
+                continue;
+            }
+            const double scaled =
+                static_cast<double>(value) * enabled / running;
+            state.counters[counter.name] =
+                benchmark::Counter(scaled, benchmark::Counter::kAvgIterations);
+        }
+    }
+
+   private:
+    // With PERF_FORMAT_TOTAL_TIME_* a read returns the value followed by the
+    // time the event was enabled and the time it was running.
+    using Values = std::uint64_t[3];
+
+    struct Counter {
+        const char* name;
+        int fd;
+        // The values when the benchmark started, if they could be read.
+        Values start = {};
+        bool started = false;
+    };
+
+    static bool readValues(int fd, Values& values) {
+        return read(fd, values, sizeof(values)) == sizeof(values);
+    }
+
+    PerfCounters() {
+        for (const auto& event : kPerfEvents) {
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = event.type;
+            attr.config = event.config;
+            attr.disabled = 1;
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                               PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            const int fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+            if (fd >= 0) {
+                _counters.push_back({event.name, fd, {}, false});
+            }
+        }
+        if (_counters.empty()) {
+            std::cerr << "Hardware performance counters are unavailable; "
+                         "check /proc/sys/kernel/perf_event_paranoid"
+                      << std::endl;
+        }
+    }
+
+    ~PerfCounters() {
+        for (auto& counter : _counters) {
+            close(counter.fd);
+        }
+    }
+
+    std::vector<Counter> _counters;
+};
+
+[[maybe_unused]] PerfCounters& gPerfCounters = PerfCounters::get();
+
+#endif
+
+}  // namespace
+
+BenchmarkCounters::BenchmarkCounters(benchmark::State& state,
+                                     bool countAllocations)
+    : _state(state), _countAllocations(countAllocations) {
+    gNumAllocations.store(0);
+    gBytesAllocated.store(0);
+    gLiveBytes.store(0);
+    gPeakLiveBytes.store(0);
+    gCountingAllocations.store(countAllocations);
+#ifdef BENCHMARKS_PERF_COUNTERS
+    PerfCounters::get().start();
+#endif
+}
+
+void BenchmarkCounters::pause() {
+#ifdef BENCHMARKS_PERF_COUNTERS
+    PerfCounters::get().pause();
+#endif
+}
+
+void BenchmarkCounters::resume() {
+#ifdef BENCHMARKS_PERF_COUNTERS
+    PerfCounters::get().resume();
+#endif
+}
+
+void BenchmarkCounters::stop() {
+    if (_stopped) {
+        return;
+    }
+    _stopped = true;
+
+    // Take everything before touching state.counters, which allocates.
+    gCountingAllocations.store(false);
+    [[maybe_unused]] const auto numAllocations = gNumAllocations.load();
+    [[maybe_unused]] const auto bytesAllocated = gBytesAllocated.load();
+    [[maybe_unused]] const auto peakLiveBytes = gPeakLiveBytes.load();
+
+#ifdef BENCHMARKS_PERF_COUNTERS
+    PerfCounters::get().stop(_state);
+#endif
+#ifdef BENCHMARKS_COUNT_ALLOCATIONS
+    if (_countAllocations) {
+        _state.counters["allocs"] = benchmark::Counter(
+            numAllocations, benchmark::Counter::kAvgIterations);
+        _state.counters["bytes_allocated"] = benchmark::Counter(
+            bytesAllocated, benchmark::Counter::kAvgIterations);
+        _state.counters["peak_live_bytes"] = peakLiveBytes;
+    }
+#endif
+}
+
+BenchmarkCounters::~BenchmarkCounters() { stop(); }
+
+#ifdef BENCHMARKS_COUNT_ALLOCATIONS
+
+#ifdef BENCHMARKS_COUNT_MALLOC
+// The malloc wrappers below already count everything operator new gets from
+// malloc and everything operator delete gives back to free.
+constexpr bool kCountInOperatorNew = false;
+
+extern "C" {
+void* __real_malloc(std::size_t size);
+void* __real_calloc(std::size_t count, std::size_t size);
+void* __real_realloc(void* ptr, std::size_t size);
+void __real_free(void* ptr);
+
+void* __wrap_malloc(std::size_t size) {
+    auto ptr = __real_malloc(size);
+    recordAllocation(ptr);
+    return ptr;
+}
+
+void* __wrap_calloc(std::size_t count, std::size_t size) {
+    auto ptr = __real_calloc(count, size);
+    recordAllocation(ptr);
+    return ptr;
+}
+
+void* __wrap_realloc(void* ptr, std::size_t size) {
+    const bool counting = countingAllocations();
+    const std::int64_t oldSize =
+        ptr && counting ? malloc_usable_size(ptr) : 0;
+    auto newPtr = __real_realloc(ptr, size);
+    if (counting && (newPtr || size == 0)) {
+        gLiveBytes.fetch_sub(oldSize, std::memory_order_relaxed);
+        recordAllocation(newPtr);
+    }
+    return newPtr;
+}
+
+void __wrap_free(void* ptr) {
+    recordDeallocation(ptr);
+    __real_free(ptr);
+}
+}
+#else
+constexpr bool kCountInOperatorNew = true;
+#endif
+
+namespace {
+
+void* countedNew(std::size_t size) {
+    auto ptr = std::malloc(size ? size : 1);
+    if (kCountInOperatorNew) {
+        recordAllocation(ptr);
+    }
+    return ptr;
+}
+
+void* countedAlignedNew(std::size_t size, std::align_val_t alignment) {
+    // posix_memalign isn't wrapped, so these are always counted here.
+    void* ptr = nullptr;
+    if (posix_memalign(&ptr, std::max(static_cast<std::size_t>(alignment),
+                                      sizeof(void*)),
+                       size ? size : 1) != 0) {
+        return nullptr;
+    }
+    recordAllocation(ptr);
+    return ptr;
+}
+
+// operator new gets its memory from malloc, so free is the matching way to
+// give it back. GCC doesn't know that, and warns (-Wmismatched-new-delete)
+// wherever it can inline operator delete into code that called operator new,
+// e.g. a std::vector in this file, so these stay out of line.
+
+[[gnu::noinline]] void countedDelete(void* ptr) {
+    if (kCountInOperatorNew) {
+        recordDeallocation(ptr);
+    }
+    std::free(ptr);
+}
+
+[[gnu::noinline]] void countedAlignedDelete(void* ptr) {
+#ifndef BENCHMARKS_COUNT_MALLOC
+    recordDeallocation(ptr);
+#endif
+    std::free(ptr);
+}
+
+}  // namespace
+
+void* operator new(std::size_t size) {
+    if (auto ptr = countedNew(size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    if (auto ptr = countedNew(size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return countedNew(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return countedNew(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    if (auto ptr = countedAlignedNew(size, alignment)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    if (auto ptr = countedAlignedNew(size, alignment)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment,
+                   const std::nothrow_t&) noexcept {
+    return countedAlignedNew(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment,
+                     const std::nothrow_t&) noexcept {
+    return countedAlignedNew(size, alignment);
+}
+
+void operator delete(void* ptr) noexcept { countedDelete(ptr); }
+void operator delete[](void* ptr) noexcept { countedDelete(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { countedDelete(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { countedDelete(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    countedDelete(ptr);
+}
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    countedDelete(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    countedAlignedDelete(ptr);
+}
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+    countedAlignedDelete(ptr);
+}
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept {
+    countedAlignedDelete(ptr);
+}
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept {
+    countedAlignedDelete(ptr);
+}
+void operator delete(void* ptr, std::align_val_t,
+                     const std::nothrow_t&) noexcept {
+    countedAlignedDelete(ptr);
+}
+void operator delete[](void* ptr, std::align_val_t,
+                       const std::nothrow_t&) noexcept {
+    countedAlignedDelete(ptr);
+}
+
+#endif
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+
+/**
+ * Measures what a benchmark does from when this is constructed until stop()
+ * (or the destructor) and reports it through state.counters. Construct it
+ * right before the timed loop so that setup isn't counted, and stop it as
+ * soon as the loop ends if the benchmark does anything after it, since
+ * reporting its own counters allocates too:
+ *
+ *     BenchmarkCounters counters(state);
+ *     for (auto _ : state) {
+ *         ...
+ *     }
+ *     counters.stop();
+ *
+ * Reports:
+ *  - allocs: allocations per iteration
+ *  - bytes_allocated: bytes allocated per iteration
+ *  - peak_live_bytes: the most memory that was live at once, on top of what
+ *    was already allocated when counting started
+ *
+ *  - cycles, instructions, l1d_misses, llc_misses, branch_misses and
+ *    dtlb_misses per iteration, from perf_event_open, for whichever of those
+ *    the kernel lets us count
+ *
+ * Allocations are counted through operator new, and through malloc as well
+ * when built with BENCHMARKS_COUNT_MALLOC. Nothing is counted when built with
+ * BENCHMARKS_COUNT_ALLOCATIONS=OFF, or when countAllocations is false, which
+ * benchmarks of the allocator itself use so that counting doesn't get in the
+ * way of what they measure. Hardware counters are only available on Linux
+ * and can be turned off with BENCHMARKS_PERF_COUNTERS=OFF.
+ */
+class BenchmarkCounters {
+   public:
+    explicit BenchmarkCounters(benchmark::State& state,
+                               bool countAllocations = true);
+    ~BenchmarkCounters();
+
+    BenchmarkCounters(const BenchmarkCounters&) = delete;
+    BenchmarkCounters& operator=(const BenchmarkCounters&) = delete;
+
+    // Stop and restart the hardware counters around work that the benchmark
+    // leaves out of its timings with state.PauseTiming().
+    void pause();
+    void resume();
+
+    // Stops counting and reports the counters. Only the first call does
+    // anything.
+    void stop();
+
+   private:
+    benchmark::State& _state;
+    bool _countAllocations;
+    bool _stopped = false;
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define BENCHMARKS_FUTEX 1
+#endif
+
+#ifdef BENCHMARKS_FUTEX
+
+/**
+ * Sleeps until woken by futexWake on the same word, unless it no longer holds
+ * expected. May also return spuriously, so callers recheck in a loop.
+ */
+inline void futexWait(std::atomic<std::uint32_t>& word,
+                      std::uint32_t expected) {
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word),
+            FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+/**
+ * Wakes up to count threads sleeping in futexWait on word.
+ */
+inline void futexWake(std::atomic<std::uint32_t>& word, int count) {
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word),
+            FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+
+#endif
@@ -0,0 +1,372 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BENCHMARKS_X86 1
+#endif
+
+#include "barrier.h"
+#include "counters.h"
+#include "threads.h"
+
+/*****************************************************************************
+ * MATRIX MULTIPLICATION
+ *
+ * C = A * B for n x n row-major matrices, one step at a time from the
+ * textbook triple loop to something that gets close to the hardware's peak:
+ *
+ *  1. naive: i-j-k, the inner loop walks down a column of B
+ *  2. reordered: i-k-j, the inner loop walks along rows of B and C, and
+ *     vectorizes
+ *  3. blocked: i-k-j over tiles small enough to stay in L1/L2
+ *  4. packed: copies panels of A and B into contiguous buffers in the order
+ *     the kernel reads them, and computes 6 x 16 blocks of C with an AVX2/FMA
+ *     micro-kernel that keeps the whole block in registers
+ *  5. threaded: the packed version with the rows of C split between threads
+ *     that stay alive across iterations, and each panel of B packed once and
+ *     shared between them
+ *
+ * Steps 1-3 are templated so the std::uint32_t matrices of the cache
+ * benchmarks can be compared with float; 4 and 5 are float only. Each reports
+ * flops as the rate of multiply-adds times two.
+ *****************************************************************************/
+
+namespace {
+
+template <typename T>
+std::vector<T> makeMatrix(std::size_t n) {
+    std::vector<T> m(n * n);
+    for (std::size_t i = 0; i < n; ++i) {
+        for (std::size_t j = 0; j < n; ++j) {
+            // Small values so that float results are exact.
+            m[i * n + j] = static_cast<T>((i + j) % 8);
+        }
+    }
+    return m;
+}
+
+/**
+ * Compares a few elements of c against dot products computed directly.
+ */
+template <typename T>
+bool spotCheck(const std::vector<T>& a, const std::vector<T>& b,
+               const std::vector<T>& c, std::size_t n) {
+    for (std::size_t s = 0; s < 16; ++s) {
+        const auto i = (s * 7919) % n;
+        const auto j = (s * 104729) % n;
+        T expected = 0;
+        for (std::size_t k = 0; k < n; ++k) {
+            expected += a[i * n + k] * b[k * n + j];
+        }
+        if (c[i * n + j] != expected) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename T>
+void gemmNaive(const T* a, const T* b, T* c, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) {
+        for (std::size_t j = 0; j < n; ++j) {
+            T sum = 0;
+            for (std::size_t k = 0; k < n; ++k) {
+                sum += a[i * n + k] * b[k * n + j];
+            }
+            c[i * n + j] = sum;
+        }
+    }
+}
+
+template <typename T>
+void gemmReordered(const T* a, const T* b, T* c, std::size_t n) {
+    std::fill(c, c + n * n, 0);
+    for (std::size_t i = 0; i < n; ++i) {
+        for (std::size_t k = 0; k < n; ++k) {
+            const T aik = a[i * n + k];
+            for (std::size_t j = 0; j < n; ++j) {
+                c[i * n + j] += aik * b[k * n + j];
+            }
+        }
+    }
+}
+
+// 64 x 64 tiles: a tile of B is 16 KiB of floats, which fits in L1, and the
+// tiles of A, B and C together fit comfortably in L2.
+const std::size_t kGemmTile = 64;
+
+template <typename T>
+void gemmBlocked(const T* a, const T* b, T* c, std::size_t n) {
+    std::fill(c, c + n * n, 0);
+    for (std::size_t ii = 0; ii < n; ii += kGemmTile) {
+        const auto iEnd = std::min(ii + kGemmTile, n);
+        for (std::size_t kk = 0; kk < n; kk += kGemmTile) {
+            const auto kEnd = std::min(kk + kGemmTile, n);
+            for (std::size_t jj = 0; jj < n; jj += kGemmTile) {
+                const auto jEnd = std::min(jj + kGemmTile, n);
+                for (auto i = ii; i < iEnd; ++i) {
+                    for (auto k = kk; k < kEnd; ++k) {
+                        const T aik = a[i * n + k];
+                        for (auto j = jj; j < jEnd; ++j) {
+                            c[i * n + j] += aik * b[k * n + j];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+#ifdef BENCHMARKS_X86
+
+// Micro-kernel block: 6 rows x 16 columns of C is 12 ymm accumulators, which
+// leaves registers for one row of B and a broadcast element of A.
+const std::size_t kMR = 6;
+const std::size_t kNR = 16;
+// Cache blocking for the packed panels: a kKC x kNR panel of B stays in L1,
+// a kMC x kKC block of A stays in L2.
+const std::size_t kMC = 96;
+const std::size_t kKC = 256;
+
+/**
+ * Copies rows [rowBegin, rowEnd) and columns [colBegin, colBegin + kc) of a
+ * into panels of kMR rows, each stored column by column, padding the last
+ * panel with zeros.
+ */
+void packA(const float* a, std::size_t n, std::size_t rowBegin,
+           std::size_t rowEnd, std::size_t colBegin, std::size_t kc,
+           float* packed) {
+    for (auto panel = rowBegin; panel < rowEnd; panel += kMR) {
+        for (std::size_t k = 0; k < kc; ++k) {
+            for (std::size_t r = 0; r < kMR; ++r) {
+                const auto row = panel + r;
+                *packed++ = row < rowEnd ? a[row * n + colBegin + k] : 0.0f;
+            }
+        }
+    }
+}
+
+/**
+ * Copies rows [rowBegin, rowBegin + kc) and columns [colBegin, colEnd) of b
+ * into panels of kNR columns, each stored row by row, at the same place in
+ * packed as if every column were being packed. n, colBegin and colEnd are
+ * always multiples of kNR here.
+ */
+void packB(const float* b, std::size_t n, std::size_t rowBegin,
+           std::size_t kc, std::size_t colBegin, std::size_t colEnd,
+           float* packed) {
+    packed += colBegin * kc;
+    for (auto panel = colBegin; panel < colEnd; panel += kNR) {
+        for (std::size_t k = 0; k < kc; ++k) {
+            const float* src = b + (rowBegin + k) * n + panel;
+            std::copy(src, src + kNR, packed);
+            packed += kNR;
+        }
+    }
+}
+
+/**
+ * c[0:rows, 0:16] += a * b, where a is a packed kc x kMR panel and b is a
+ * packed kc x kNR panel.
+ */
+[[gnu::target("avx2,fma")]] void microKernelAvx2(std::size_t kc,
+                                                 const float* a,
+                                                 const float* b, float* c,
+                                                 std::size_t ldc,
+                                                 std::size_t rows) {
+    __m256 acc[kMR][2];
+    for (std::size_t r = 0; r < kMR; ++r) {
+        acc[r][0] = _mm256_setzero_ps();
+        acc[r][1] = _mm256_setzero_ps();
+    }
+
+    for (std::size_t k = 0; k < kc; ++k) {
+        const __m256 b0 = _mm256_loadu_ps(b);
+        const __m256 b1 = _mm256_loadu_ps(b + 8);
+        for (std::size_t r = 0; r < kMR; ++r) {
+            const __m256 ar = _mm256_broadcast_ss(a + r);
+            acc[r][0] = _mm256_fmadd_ps(ar, b0, acc[r][0]);
+            acc[r][1] = _mm256_fmadd_ps(ar, b1, acc[r][1]);
+        }
+        a += kMR;
+        b += kNR;
+    }
+
+    for (std::size_t r = 0; r < rows; ++r) {
+        float* row = c + r * ldc;
+        _mm256_storeu_ps(row, _mm256_add_ps(_mm256_loadu_ps(row), acc[r][0]));
+        _mm256_storeu_ps(row + 8,
+                         _mm256_add_ps(_mm256_loadu_ps(row + 8), acc[r][1]));
+    }
+}
+
+/**
+ * Adds a[rowBegin:rowEnd, pc:pc + kc] * b[pc:pc + kc, :] to the same rows of
+ * c, given those rows of b packed by packB. packedA has room for a kMC x kKC
+ * block.
+ */
+void multiplyPackedPanel(const float* a, const float* packedB, float* c,
+                         std::size_t n, std::size_t pc, std::size_t kc,
+                         std::size_t rowBegin, std::size_t rowEnd,
+                         float* packedA) {
+    for (auto ic = rowBegin; ic < rowEnd; ic += kMC) {
+        const auto icEnd = std::min(ic + kMC, rowEnd);
+        packA(a, n, ic, icEnd, pc, kc, packedA);
+        for (std::size_t jr = 0; jr < n; jr += kNR) {
+            for (auto ir = ic; ir < icEnd; ir += kMR) {
+                microKernelAvx2(kc, &packedA[(ir - ic) * kc],
+                                &packedB[jr * kc], c + ir * n + jr, n,
+                                std::min(kMR, icEnd - ir));
+            }
+        }
+    }
+}
+
+void gemmPacked(const float* a, const float* b, float* c, std::size_t n) {
+    std::vector<float> packedA((kMC + kMR) * kKC);
+    std::vector<float> packedB(n * kKC);
+
+    std::fill(c, c + n * n, 0.0f);
+    for (std::size_t pc = 0; pc < n; pc += kKC) {
+        const auto kc = std::min(kKC, n - pc);
+        packB(b, n, pc, kc, 0, n, packedB.data());
+        multiplyPackedPanel(a, packedB.data(), c, n, pc, kc, 0, n,
+                            packedA.data());
+    }
+}
+
+/**
+ * The packed version on a pool of threads, each computing its own rows of c.
+ * For each panel of b, the threads pack a share of its columns each into one
+ * shared buffer and wait for each other before using it, so b is packed once
+ * in all rather than once per thread.
+ */
+void gemmThreaded(WorkerThreads& workers, int numThreads, const float* a,
+                  const float* b, float* c, std::size_t n) {
+    // Give each thread a whole number of micro-kernel rows and of panels.
+    const auto rowsPerThread =
+        std::max(kMR, (n / numThreads + kMR - 1) / kMR * kMR);
+    const auto colsPerThread =
+        std::max(kNR, (n / numThreads + kNR - 1) / kNR * kNR);
+    std::vector<float> packedB(n * kKC);
+    BackoffBarrier packed(numThreads);
+
+    workers.run([&](int t) {
+        const auto rowBegin = std::min(t * rowsPerThread, n);
+        const auto rowEnd = std::min(rowBegin + rowsPerThread, n);
+        const auto colBegin = std::min(t * colsPerThread, n);
+        const auto colEnd = std::min(colBegin + colsPerThread, n);
+        std::vector<float> packedA((kMC + kMR) * kKC);
+
+        std::fill(c + rowBegin * n, c + rowEnd * n, 0.0f);
+        for (std::size_t pc = 0; pc < n; pc += kKC) {
+            const auto kc = std::min(kKC, n - pc);
+            packB(b, n, pc, kc, colBegin, colEnd, packedB.data());
+            packed.arriveAndWait();
+            multiplyPackedPanel(a, packedB.data(), c, n, pc, kc, rowBegin,
+                                rowEnd, packedA.data());
+            // Nobody packs the next panel over this one until everyone is
+            // done with it.
+            packed.arriveAndWait();
+        }
+    });
+}
+
+bool hasAvx2Fma() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+
+#endif
+
+}  // namespace
+
+template <typename T, typename Gemm>
+static void runGemm(benchmark::State& state, Gemm&& gemm) {
+    const std::size_t n = state.range(0);
+    const auto a = makeMatrix<T>(n);
+    const auto b = makeMatrix<T>(n);
+    std::vector<T> c(n * n);
+
+    gemm(a.data(), b.data(), c.data(), n);
+    if (!spotCheck(a, b, c, n)) {
+        state.SkipWithError("Wrong result");
+        return;
+    }
+
+    BenchmarkCounters counters(state);
+    for (auto _ : state) {
+        gemm(a.data(), b.data(), c.data(), n);
+        benchmark::ClobberMemory();
+    }
+    counters.stop();
+
+    state.counters["flops"] =
+        benchmark::Counter(2.0 * n * n * n,
+                           benchmark::Counter::kIsIterationInvariantRate);
+}
+
+template <typename T>
+static void BM_gemmNaive(benchmark::State& state) {
+    runGemm<T>(state, gemmNaive<T>);
+}
+
+template <typename T>
+static void BM_gemmReordered(benchmark::State& state) {
+    runGemm<T>(state, gemmReordered<T>);
+}
+
+template <typename T>
+static void BM_gemmBlocked(benchmark::State& state) {
+    runGemm<T>(state, gemmBlocked<T>);
+}
+
+#ifdef BENCHMARKS_X86
+
+static void BM_gemmPacked(benchmark::State& state) {
+    if (!hasAvx2Fma()) {
+        state.SkipWithError("Needs AVX2 and FMA");
+        return;
+    }
+    runGemm<float>(state, gemmPacked);
+}
+
+static void BM_gemmThreaded(benchmark::State& state) {
+    if (!hasAvx2Fma()) {
+        state.SkipWithError("Needs AVX2 and FMA");
+        return;
+    }
+    const int numThreads = std::max(1u, std::thread::hardware_concurrency());
+    WorkerThreads workers(numThreads);
+    runGemm<float>(state, [&](const float* a, const float* b, float* c,
+                              std::size_t n) {
+        gemmThreaded(workers, numThreads, a, b, c, n);
+    });
+}
+
+#endif
+
+static void gemmArguments(benchmark::internal::Benchmark* b) {
+    b->ArgName("n")->RangeMultiplier(2)->Range(64, 4'096);
+}
+
+// The naive version takes minutes per iteration beyond this.
+static void naiveGemmArguments(benchmark::internal::Benchmark* b) {
+    b->ArgName("n")->RangeMultiplier(2)->Range(64, 1'024);
+}
+
+BENCHMARK_TEMPLATE(BM_gemmNaive, std::uint32_t)->Apply(naiveGemmArguments);
+BENCHMARK_TEMPLATE(BM_gemmNaive, float)->Apply(naiveGemmArguments);
+BENCHMARK_TEMPLATE(BM_gemmReordered, std::uint32_t)->Apply(gemmArguments);
+BENCHMARK_TEMPLATE(BM_gemmReordered, float)->Apply(gemmArguments);
+BENCHMARK_TEMPLATE(BM_gemmBlocked, std::uint32_t)->Apply(gemmArguments);
+BENCHMARK_TEMPLATE(BM_gemmBlocked, float)->Apply(gemmArguments);
+#ifdef BENCHMARKS_X86
+BENCHMARK(BM_gemmPacked)->Apply(gemmArguments);
+BENCHMARK(BM_gemmThreaded)->Apply(gemmArguments)->UseRealTime();
+#endif
@@ -0,0 +1,132 @@
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "counters.h"
+
+/*****************************************************************************
+ * INSTRUCTION CACHE
+ *
+ * The function call benchmarks all call one tiny function over and over, so
+ * the code they run always fits in the L1 instruction cache and the uop
+ * cache. Here a template stamps out thousands of distinct functions of
+ * about 350 bytes each, and the benchmarks call the first N of them through
+ * a table, either round-robin or in a random order. Once N functions don't
+ * fit in the uop cache and L1i (32 KiB on most x86 cores, i.e. under a
+ * hundred of these) every call starts with an instruction fetch miss, and the
+ * front end stalls even though the work done per call doesn't change.
+ *
+ * N = 1 is the single hot function, called the same way.
+ *
+ * The function sizes, and so where the steps fall, are for GCC. Clang
+ * ignores the gnu::optimize attribute that keeps each function's lanes in
+ * scalar instructions, and may vectorize them into noticeably smaller code,
+ * which moves the knees to larger N.
+ *****************************************************************************/
+
+namespace {
+
+using CodeBlock = std::uint32_t (*)(std::uint32_t);
+
+// Each step is eight cheap instructions on four independent values, with
+// 32-bit immediates that depend on kId, so that the functions are big but
+// quick to execute, and no two instantiations compile to the same code (which
+// the linker would fold together). SLP vectorization is off so that GCC
+// keeps the four lanes in scalar instructions; there's no way to ask clang
+// for the same on one function.
+#define BENCHMARKS_CODE_BLOCK_CONSTANT(n, lane) \
+    static_cast<std::uint32_t>(kId * 0x9e3779b9u + n * 0x85ebca6bu + lane)
+#define BENCHMARKS_CODE_BLOCK_STEP(n)                \
+    a = (a + BENCHMARKS_CODE_BLOCK_CONSTANT(n, 0)) ^ \
+        BENCHMARKS_CODE_BLOCK_CONSTANT(n, 1);        \
+    b = (b + BENCHMARKS_CODE_BLOCK_CONSTANT(n, 2)) ^ \
+        BENCHMARKS_CODE_BLOCK_CONSTANT(n, 3);        \
+    c = (c + BENCHMARKS_CODE_BLOCK_CONSTANT(n, 4)) ^ \
+        BENCHMARKS_CODE_BLOCK_CONSTANT(n, 5);        \
+    d = (d + BENCHMARKS_CODE_BLOCK_CONSTANT(n, 6)) ^ \
+        BENCHMARKS_CODE_BLOCK_CONSTANT(n, 7);
+
+template <std::size_t kId>
+[[gnu::noinline, gnu::optimize("no-tree-slp-vectorize")]] std::uint32_t
+codeBlock(std::uint32_t x) {
+    std::uint32_t a = x, b = x + 1, c = x + 2, d = x + 3;
+    BENCHMARKS_CODE_BLOCK_STEP(1)
+    BENCHMARKS_CODE_BLOCK_STEP(2)
+    BENCHMARKS_CODE_BLOCK_STEP(3)
+    BENCHMARKS_CODE_BLOCK_STEP(4)
+    BENCHMARKS_CODE_BLOCK_STEP(5)
+    BENCHMARKS_CODE_BLOCK_STEP(6)
+    BENCHMARKS_CODE_BLOCK_STEP(7)
+    BENCHMARKS_CODE_BLOCK_STEP(8)
+    return a ^ b ^ c ^ d;
+}
+
+#undef BENCHMARKS_CODE_BLOCK_STEP
+#undef BENCHMARKS_CODE_BLOCK_CONSTANT
+
+const std::size_t kMaxCodeBlocks = 4'096;
+
+template <std::size_t... kIds>
+std::array<CodeBlock, sizeof...(kIds)> makeCodeBlocks(
+    std::index_sequence<kIds...>) {
+    return {{&codeBlock<kIds>...}};
+}
+
+const auto kCodeBlocks =
+    makeCodeBlocks(std::make_index_sequence<kMaxCodeBlocks>{});
+
+const std::size_t kCallsPerIteration = 4'096;
+
+}  // namespace
+
+static void BM_codeFootprintRoundRobin(benchmark::State& state) {
+    // Always a power of two, so the mask below picks the next one.
+    const std::size_t numFunctions = state.range(0);
+
+    std::uint32_t x = 1;
+    BenchmarkCounters counters(state);
+    for (auto _ : state) {
+        for (std::size_t i = 0; i < kCallsPerIteration; ++i) {
+            x = kCodeBlocks[i & (numFunctions - 1)](x);
+        }
+        benchmark::DoNotOptimize(x);
+    }
+    counters.stop();
+
+    state.SetItemsProcessed(state.iterations() * kCallsPerIteration);
+}
+
+static void BM_codeFootprintRandom(benchmark::State& state) {
+    const std::size_t numFunctions = state.range(0);
+
+    // Generate the call order up front so the RNG isn't timed.
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<std::size_t> dist(0, numFunctions - 1);
+    std::vector<CodeBlock> order(kCallsPerIteration);
+    for (auto& fn : order) {
+        fn = kCodeBlocks[dist(gen)];
+    }
+
+    std::uint32_t x = 1;
+    BenchmarkCounters counters(state);
+    for (auto _ : state) {
+        for (auto fn : order) {
+            x = fn(x);
+        }
+        benchmark::DoNotOptimize(x);
+    }
+    counters.stop();
+
+    state.SetItemsProcessed(state.iterations() * kCallsPerIteration);
+}
+
+static void codeFootprintArguments(benchmark::internal::Benchmark* b) {
+    b->ArgName("functions")->RangeMultiplier(4)->Range(1, kMaxCodeBlocks);
+}
+
+BENCHMARK(BM_codeFootprintRoundRobin)->Apply(codeFootprintArguments);
+BENCHMARK(BM_codeFootprintRandom)->Apply(codeFootprintArguments);
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+/**
+ * Counts latencies in log-linear buckets: eight per power of two, so any
+ * value is reported to within 12.5%. Recording doesn't allocate, so it can
+ * be done in the timed loop, and each thread can keep its own and merge them
+ * afterwards.
+ */
+class LatencyHistogram {
+   public:
+    void record(std::uint64_t ns) { ++_counts[bucket(ns)]; }
+
+    void merge(const LatencyHistogram& other) {
+        for (std::size_t i = 0; i < _counts.size(); ++i) {
+            _counts[i] += other._counts[i];
+        }
+    }
+
+    /**
+     * The upper end of the bucket that the given fraction (0 to 1) of the
+     * recorded latencies fall at or below, or 0 if nothing was recorded.
+     */
+    std::uint64_t percentile(double fraction) const {
+        std::uint64_t total = 0;
+        for (auto count : _counts) {
+            total += count;
+        }
+        const auto target = std::max<std::uint64_t>(1, fraction * total);
+
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < _counts.size(); ++i) {
+            seen += _counts[i];
+            if (_counts[i] && seen >= target) {
+                return upperBound(i);
+            }
+        }
+        return 0;
+    }
+
+    std::uint64_t max() const { return percentile(1); }
+
+   private:
+    static constexpr int kSubBucketBits = 3;
+    static constexpr int kSubBuckets = 1 << kSubBucketBits;
+
+    // Values below kSubBuckets get a bucket each; after that, each power of
+    // two is split into kSubBuckets.
+    static std::size_t bucket(std::uint64_t ns) {
+        if (ns < kSubBuckets) {
+            return ns;
+        }
+        const int log2 = 63 - __builtin_clzll(ns);
+        const auto subBucket = (ns >> (log2 - kSubBucketBits)) - kSubBuckets;
+        return (log2 - kSubBucketBits + 1) * kSubBuckets + subBucket;
+    }
+
+    static std::uint64_t upperBound(std::size_t bucket) {
+        if (bucket < kSubBuckets) {
+            return bucket;
+        }
+        const int shift = bucket / kSubBuckets - 1;
+        const auto subBucket = bucket % kSubBuckets;
+        return ((kSubBuckets + subBucket + 1) << shift) - 1;
+    }
+
+    std::array<std::uint64_t, (64 - kSubBucketBits + 1) * kSubBuckets>
+        _counts{};
+};
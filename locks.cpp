@@ -0,0 +1,378 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+#include "counters.h"
+#include "latency.h"
+#include "locks.h"
+#include "threads.h"
+
+/*****************************************************************************
+ * SPINLOCKS VS. STD::MUTEX
+ *
+ * The same workload as BM_useMutex, with each of the locks in locks.h in
+ * place of std::mutex: 1 to hardware_concurrency() threads split a number of
+ * increments of a shared counter between them, taking the lock for every one.
+ *
+ * A bare increment is the shortest critical section there is, so each thread
+ * also spins for critical_ns while it holds the lock, and for think_ns
+ * between releasing it and taking it again. The ratio of the two sets how
+ * likely a thread is to find the lock taken, and sweeping them shows where
+ * each lock stops (or starts) being the right choice.
+ *
+ * The largest thread count is twice the number of hardware threads. Pure
+ * spinlocks fall apart there, since a waiter can spin away the time slice
+ * the holder needs to release the lock; SpinThenParkMutex spins for a while
+ * and then sleeps, to get a spinlock's short waits without that. The FIFO
+ * locks (TicketLock, McsLock and ClhLock) don't run at that count: they hand
+ * the lock to the next waiter whether it's running or not, so every handoff
+ * to a preempted waiter waits out a whole time slice and a single run takes
+ * minutes. BM_oversubscribed below covers McsLock with far fewer
+ * acquisitions.
+ *****************************************************************************/
+
+namespace {
+
+// Acquisitions per iteration, split between the threads, when there's no
+// critical section or think time.
+const std::int64_t kNumLockAcquisitions = 1'000'000;
+
+// With long critical sections or think time, there are only as many
+// acquisitions as would take about this long on one thread.
+const std::int64_t kLockWorkBudgetNs = 10'000'000;
+
+/**
+ * Spins for the given number of iterations without touching memory.
+ */
+void simulateWork(std::int64_t iterations) {
+    for (std::int64_t i = 0; i < iterations; ++i) {
+        benchmark::DoNotOptimize(i);
+    }
+}
+
+/**
+ * How many iterations of simulateWork take about ns nanoseconds on this
+ * machine, measured once.
+ */
+std::int64_t simulatedWorkIterations(std::int64_t ns) {
+    static const double iterationsPerNs = [] {
+        const std::int64_t iterations = 10'000'000;
+        auto start = std::chrono::steady_clock::now();
+        simulateWork(iterations);
+        auto end = std::chrono::steady_clock::now();
+        return iterations /
+               std::chrono::duration<double, std::nano>(end - start).count();
+    }();
+    return static_cast<std::int64_t>(ns * iterationsPerNs);
+}
+
+}  // namespace
+
+template <typename Lock>
+static void BM_lock(benchmark::State& state) {
+    const int numThreads = state.range(0);
+    const std::int64_t criticalNs = state.range(1);
+    const std::int64_t thinkNs = state.range(2);
+    const auto criticalIterations = simulatedWorkIterations(criticalNs);
+    const auto thinkIterations = simulatedWorkIterations(thinkNs);
+    const auto acquisitionsPerThread = std::max<std::int64_t>(
+        1, std::min(kNumLockAcquisitions,
+                    kLockWorkBudgetNs / (criticalNs + thinkNs + 1)) /
+               numThreads);
+    Lock lock;
+    std::uint64_t counter{0};
+
+    WorkerThreads workers(numThreads);
+    BenchmarkCounters counters(state);
+    for (auto _ : state) {
+        state.SetIterationTime(workers.run([&](int) {
+            for (std::int64_t i = 0; i < acquisitionsPerThread; ++i) {
+                {
+                    std::lock_guard lk(lock);
+                    benchmark::DoNotOptimize(++counter);
+                    simulateWork(criticalIterations);
+                }
+                simulateWork(thinkIterations);
+            }
+        }));
+    }
+    counters.stop();
+
+    // A lock that lets two threads in at once loses increments.
+    if (counter != static_cast<std::uint64_t>(state.iterations()) *
+                       acquisitionsPerThread * numThreads) {
+        state.SkipWithError("Lost increments; the lock is broken");
+        return;
+    }
+    setThroughputCounters(state, acquisitionsPerThread * numThreads,
+                          numThreads);
+}
+
+static void addLockArguments(benchmark::internal::Benchmark* b,
+                             const std::vector<int>& counts) {
+    b->ArgNames({"threads", "critical_ns", "think_ns"});
+    for (auto threads : counts) {
+        for (auto criticalNs : {0, 100, 1'000, 10'000}) {
+            for (auto thinkNs : {0, 100, 1'000, 10'000}) {
+                b->Args({threads, criticalNs, thinkNs});
+            }
+        }
+    }
+}
+
+static void lockArguments(benchmark::internal::Benchmark* b) {
+    // Plus twice as many threads as CPUs, where a waiter that spins can keep
+    // the thread holding the lock from getting the CPU back.
+    auto counts = threadCounts();
+    counts.push_back(2 * counts.back());
+    addLockArguments(b, counts);
+}
+
+static void fifoLockArguments(benchmark::internal::Benchmark* b) {
+    addLockArguments(b, threadCounts());
+}
+
+BENCHMARK_TEMPLATE(BM_lock, std::mutex)->Apply(lockArguments)->UseManualTime();
+BENCHMARK_TEMPLATE(BM_lock, TasLock)->Apply(lockArguments)->UseManualTime();
+BENCHMARK_TEMPLATE(BM_lock, TtasLock)->Apply(lockArguments)->UseManualTime();
+BENCHMARK_TEMPLATE(BM_lock, TicketLock)
+    ->Apply(fifoLockArguments)
+    ->UseManualTime();
+BENCHMARK_TEMPLATE(BM_lock, McsLock)
+    ->Apply(fifoLockArguments)
+    ->UseManualTime();
+BENCHMARK_TEMPLATE(BM_lock, ClhLock)
+    ->Apply(fifoLockArguments)
+    ->UseManualTime();
+#ifdef BENCHMARKS_ADAPTIVE_PTHREAD_MUTEX
+BENCHMARK_TEMPLATE(BM_lock, AdaptivePthreadMutex)
+    ->Apply(lockArguments)
+    ->UseManualTime();
+#endif
+#ifdef BENCHMARKS_FUTEX
+BENCHMARK_TEMPLATE(BM_lock, SpinThenParkMutex<100>)
+    ->Apply(lockArguments)
+    ->UseManualTime();
+BENCHMARK_TEMPLATE(BM_lock, SpinThenParkMutex<1'000>)
+    ->Apply(lockArguments)
+    ->UseManualTime();
+#endif
+
+/*****************************************************************************
+ * UNCONTENDED LOCKS
+ *
+ * The floor: what taking and releasing a lock nobody else wants costs. The
+ * first benchmark does it on one thread, so the time per iteration is one
+ * lock/unlock pair. The second has two threads doing the same, each with a
+ * lock of its own on its own cache lines, which should cost the same unless
+ * the lock shares something between instances (or the threads share a
+ * core). Like the false sharing benchmark, it runs the two threads unpinned
+ * and pinned in each placement.
+ *****************************************************************************/
+
+namespace {
+
+/**
+ * Takes a reader-writer lock in shared mode.
+ */
+template <typename SharedMutex>
+class SharedLock {
+   public:
+    void lock() { _mutex.lock_shared(); }
+    void unlock() { _mutex.unlock_shared(); }
+
+   private:
+    SharedMutex _mutex;
+};
+
+const std::int64_t kNumUncontendedAcquisitions = 1'000'000;
+
+}  // namespace
+
+template <typename Lock>
+static void BM_uncontendedLock(benchmark::State& state) {
+    Lock lock;
+    BenchmarkCounters counters(state);
+    for (auto _ : state) {
+        lock.lock();
+        benchmark::ClobberMemory();
+        lock.unlock();
+    }
+}
+
+template <typename Lock>
+static void BM_uncontendedLockPerThread(benchmark::State& state) {
+    const int numThreads = 2;
+    const auto cpus = benchmarkPlacementCpus(state, 0);
+    if (state.error_occurred()) {
+        return;
+    }
+    struct alignas(128) PaddedLock {
+        Lock lock;
+    };
+    std::vector<PaddedLock> locks(numThreads);
+    double seconds = 0;
+
+    WorkerThreads workers(numThreads, cpus);
+    BenchmarkCounters counters(state);
+    for (auto _ : state) {
+        const auto elapsed = workers.run([&](int t) {
+            auto& lock = locks[t].lock;
+            for (std::int64_t i = 0; i < kNumUncontendedAcquisitions; ++i) {
+                lock.lock();
+                benchmark::ClobberMemory();
+                lock.unlock();
+            }
+        });
+        state.SetIterationTime(elapsed);
+        seconds += elapsed;
+    }
+    counters.stop();
+
+    state.counters["ns_per_lock"] =
+        seconds * 1e9 / (state.iterations() * kNumUncontendedAcquisitions);
+}
+
+static void uncontendedLockArguments(benchmark::internal::Benchmark* b) {
+    b->ArgName("placement");
+    for (auto placement : kPlacements) {
+        b->Arg(static_cast<int>(placement));
+    }
+}
+
+#define BENCHMARK_UNCONTENDED_LOCK(Lock)                  \
+    BENCHMARK_TEMPLATE(BM_uncontendedLock, Lock);         \
+    BENCHMARK_TEMPLATE(BM_uncontendedLockPerThread, Lock) \
+        ->Apply(uncontendedLockArguments)                 \
+        ->UseManualTime()
+
+BENCHMARK_UNCONTENDED_LOCK(std::mutex);
+#ifdef BENCHMARKS_ADAPTIVE_PTHREAD_MUTEX
+BENCHMARK_UNCONTENDED_LOCK(AdaptivePthreadMutex);
+#endif
+BENCHMARK_UNCONTENDED_LOCK(std::shared_mutex);
+BENCHMARK_UNCONTENDED_LOCK(SharedLock<std::shared_mutex>);
+BENCHMARK_UNCONTENDED_LOCK(TasLock);
+BENCHMARK_UNCONTENDED_LOCK(TtasLock);
+BENCHMARK_UNCONTENDED_LOCK(TicketLock);
+BENCHMARK_UNCONTENDED_LOCK(McsLock);
+BENCHMARK_UNCONTENDED_LOCK(ClhLock);
+
+/*****************************************************************************
+ * OVERSUBSCRIPTION
+ *
+ * Shared counters incremented under each kind of lock, and with an atomic
+ * add, by 1, 2, 4 and 8 times as many threads as there are hardware threads.
+ * Past 1x the scheduler preempts threads in the middle of a critical
+ * section, and everyone waiting for that lock waits out the holder's time
+ * off the CPU: spinlocks keep spinning through it, queue locks can't hand
+ * the lock to a waiter that isn't running, and mutexes that sleep let the
+ * holder run again sooner.
+ *
+ * Every increment is timed on its own, so besides throughput these report
+ * p50_ns, p99_ns, p999_ns and max_ns, the latency of one increment including
+ * waiting for the lock. The two clock reads per increment add a few tens of
+ * ns to every operation.
+ *****************************************************************************/
+
+namespace {
+
+// Split between the threads.
+const std::int64_t kNumOversubscribedIncrements = 100'000;
+
+template <typename Lock>
+class LockedCounter {
+   public:
+    void increment() {
+        std::lock_guard lk(_lock);
+        benchmark::DoNotOptimize(++_value);
+    }
+
+   private:
+    Lock _lock;
+    std::uint64_t _value{0};
+};
+
+class AtomicCounter {
+   public:
+    void increment() { benchmark::DoNotOptimize(_value.fetch_add(1)); }
+
+   private:
+    std::atomic<std::uint64_t> _value{0};
+};
+
+}  // namespace
+
+template <typename Counter>
+static void BM_oversubscribed(benchmark::State& state) {
+    const int numThreads = state.range(0);
+    const auto incrementsPerThread = std::max<std::int64_t>(
+        1, kNumOversubscribedIncrements / numThreads);
+    Counter counter;
+
+    struct alignas(128) PerThread {
+        LatencyHistogram latencies;
+    };
+    std::vector<PerThread> perThread(numThreads);
+
+    WorkerThreads workers(numThreads);
+    BenchmarkCounters counters(state);
+    for (auto _ : state) {
+        state.SetIterationTime(workers.run([&](int t) {
+            using Clock = std::chrono::steady_clock;
+            auto& latencies = perThread[t].latencies;
+            for (std::int64_t i = 0; i < incrementsPerThread; ++i) {
+                const auto start = Clock::now();
+                counter.increment();
+                const auto end = Clock::now();
+                latencies.record(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        end - start)
+                        .count());
+            }
+        }));
+    }
+    counters.stop();
+
+    LatencyHistogram latencies;
+    for (const auto& thread : perThread) {
+        latencies.merge(thread.latencies);
+    }
+    setThroughputCounters(state, incrementsPerThread * numThreads,
+                          numThreads);
+    state.counters["p50_ns"] = latencies.percentile(0.5);
+    state.counters["p99_ns"] = latencies.percentile(0.99);
+    state.counters["p999_ns"] = latencies.percentile(0.999);
+    state.counters["max_ns"] = latencies.max();
+}
+
+static void oversubscribedArguments(benchmark::internal::Benchmark* b) {
+    const int hardwareThreads = threadCounts().back();
+    b->ArgName("threads");
+    for (auto factor : {1, 2, 4, 8}) {
+        b->Arg(factor * hardwareThreads);
+    }
+}
+
+#define BENCHMARK_OVERSUBSCRIBED(Counter)          \
+    BENCHMARK_TEMPLATE(BM_oversubscribed, Counter) \
+        ->Apply(oversubscribedArguments)           \
+        ->UseManualTime()
+
+BENCHMARK_OVERSUBSCRIBED(LockedCounter<std::mutex>);
+#ifdef BENCHMARKS_ADAPTIVE_PTHREAD_MUTEX
+BENCHMARK_OVERSUBSCRIBED(LockedCounter<AdaptivePthreadMutex>);
+#endif
+#ifdef BENCHMARKS_FUTEX
+BENCHMARK_OVERSUBSCRIBED(LockedCounter<SpinThenParkMutex<100>>);
+#endif
+BENCHMARK_OVERSUBSCRIBED(LockedCounter<TasLock>);
+BENCHMARK_OVERSUBSCRIBED(LockedCounter<TtasLock>);
+BENCHMARK_OVERSUBSCRIBED(LockedCounter<McsLock>);
+BENCHMARK_OVERSUBSCRIBED(AtomicCounter);
@@ -0,0 +1,300 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#if defined(__linux__)
+#include <pthread.h>
+#endif
+
+#include "futex.h"
+#include "spin.h"
+
+/*****************************************************************************
+ * SPINLOCKS
+ *
+ * All of these are BasicLockable, so they work with std::lock_guard. The
+ * queue locks (MCS and CLH) keep their queue node in a thread_local, so a
+ * thread can only hold one lock of each kind at a time, which is all the
+ * benchmarks need.
+ *****************************************************************************/
+
+/**
+ * Test-and-set: every waiter keeps writing the lock word, so the line it's on
+ * never stops moving between the waiters' caches.
+ */
+class TasLock {
+   public:
+    void lock() {
+        while (_locked.exchange(true, std::memory_order_acquire)) {
+        }
+    }
+
+    void unlock() { _locked.store(false, std::memory_order_release); }
+
+   private:
+    std::atomic<bool> _locked{false};
+};
+
+/**
+ * Test-and-test-and-set with exponential backoff: waiters spin reading their
+ * cached copy of the lock word, and only try to take it when it looks free,
+ * backing off for longer each time they lose.
+ */
+class TtasLock {
+   public:
+    void lock() {
+        Backoff backoff;
+        while (true) {
+            while (_locked.load(std::memory_order_relaxed)) {
+                cpuRelax();
+            }
+            if (!_locked.exchange(true, std::memory_order_acquire)) {
+                return;
+            }
+            backoff.pause();
+        }
+    }
+
+    void unlock() { _locked.store(false, std::memory_order_release); }
+
+   private:
+    std::atomic<bool> _locked{false};
+};
+
+/**
+ * Ticket lock: waiters are served in the order they arrived, but all of them
+ * spin on the same now-serving counter, so every unlock invalidates every
+ * waiter's copy of it.
+ */
+class TicketLock {
+   public:
+    void lock() {
+        const auto ticket = _next.fetch_add(1, std::memory_order_relaxed);
+        while (_serving.load(std::memory_order_acquire) != ticket) {
+            cpuRelax();
+        }
+    }
+
+    void unlock() {
+        _serving.store(_serving.load(std::memory_order_relaxed) + 1,
+                       std::memory_order_release);
+    }
+
+   private:
+    alignas(64) std::atomic<std::uint32_t> _next{0};
+    alignas(64) std::atomic<std::uint32_t> _serving{0};
+};
+
+/**
+ * MCS queue lock: each waiter spins on a flag in its own queue node, and the
+ * thread unlocking hands the lock to its successor by clearing just that
+ * flag, so a handoff only moves one cache line between two cores.
+ */
+class McsLock {
+   public:
+    void lock() {
+        auto& node = threadNode();
+        node.next.store(nullptr, std::memory_order_relaxed);
+        node.locked.store(true, std::memory_order_relaxed);
+        auto predecessor = _tail.exchange(&node, std::memory_order_acq_rel);
+        if (predecessor) {
+            predecessor->next.store(&node, std::memory_order_release);
+            while (node.locked.load(std::memory_order_acquire)) {
+                cpuRelax();
+            }
+        }
+    }
+
+    void unlock() {
+        auto& node = threadNode();
+        auto successor = node.next.load(std::memory_order_acquire);
+        if (!successor) {
+            auto expected = &node;
+            if (_tail.compare_exchange_strong(expected, nullptr,
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed)) {
+                return;
+            }
+            // Someone has swapped themselves in behind us but hasn't linked
+            // their node to ours yet.
+            while (!(successor = node.next.load(std::memory_order_acquire))) {
+                cpuRelax();
+            }
+        }
+        successor->locked.store(false, std::memory_order_release);
+    }
+
+   private:
+    struct alignas(64) Node {
+        std::atomic<Node*> next{nullptr};
+        std::atomic<bool> locked{false};
+    };
+
+    static Node& threadNode() {
+        thread_local Node node;
+        return node;
+    }
+
+    std::atomic<Node*> _tail{nullptr};
+};
+
+/**
+ * CLH queue lock: like MCS, but each waiter spins on its predecessor's node
+ * instead of its own, and takes that node over when it's done with the lock,
+ * so unlocking is a single store.
+ */
+class ClhLock {
+   public:
+    ClhLock() : _tail(new Node) {}
+    ~ClhLock() { delete _tail.load(); }
+
+    ClhLock(const ClhLock&) = delete;
+    ClhLock& operator=(const ClhLock&) = delete;
+
+    void lock() {
+        auto& self = threadState();
+        self.node->locked.store(true, std::memory_order_relaxed);
+        self.predecessor =
+            _tail.exchange(self.node, std::memory_order_acq_rel);
+        while (self.predecessor->locked.load(std::memory_order_acquire)) {
+            cpuRelax();
+        }
+    }
+
+    void unlock() {
+        auto& self = threadState();
+        self.node->locked.store(false, std::memory_order_release);
+        // Our node now belongs to whoever is spinning on it (or to the lock,
+        // if nobody is), and nobody will look at the predecessor's again.
+        self.node = self.predecessor;
+    }
+
+   private:
+    struct alignas(64) Node {
+        std::atomic<bool> locked{false};
+    };
+
+    struct ThreadState {
+        Node* node = new Node;
+        Node* predecessor = nullptr;
+        ~ThreadState() { delete node; }
+    };
+
+    static ThreadState& threadState() {
+        thread_local ThreadState state;
+        return state;
+    }
+
+    std::atomic<Node*> _tail;
+};
+
+#if defined(PTHREAD_ADAPTIVE_MUTEX_INITIALIZER_NP)
+
+/**
+ * glibc's adaptive mutex, which spins for a while in user space before
+ * sleeping in the kernel, unlike the default pthread mutex (and so
+ * std::mutex), which goes straight to sleep.
+ */
+class AdaptivePthreadMutex {
+   public:
+    AdaptivePthreadMutex() {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ADAPTIVE_NP);
+        pthread_mutex_init(&_mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+    }
+    ~AdaptivePthreadMutex() { pthread_mutex_destroy(&_mutex); }
+
+    AdaptivePthreadMutex(const AdaptivePthreadMutex&) = delete;
+    AdaptivePthreadMutex& operator=(const AdaptivePthreadMutex&) = delete;
+
+    void lock() { pthread_mutex_lock(&_mutex); }
+    void unlock() { pthread_mutex_unlock(&_mutex); }
+
+   private:
+    pthread_mutex_t _mutex;
+};
+
+#define BENCHMARKS_ADAPTIVE_PTHREAD_MUTEX 1
+
+#endif
+
+#if defined(__linux__)
+
+/**
+ * pthread_rwlock_t, with the same interface as std::shared_mutex.
+ */
+class PthreadRwlock {
+   public:
+    PthreadRwlock() { pthread_rwlock_init(&_rwlock, nullptr); }
+    ~PthreadRwlock() { pthread_rwlock_destroy(&_rwlock); }
+
+    PthreadRwlock(const PthreadRwlock&) = delete;
+    PthreadRwlock& operator=(const PthreadRwlock&) = delete;
+
+    void lock() { pthread_rwlock_wrlock(&_rwlock); }
+    void unlock() { pthread_rwlock_unlock(&_rwlock); }
+    void lock_shared() { pthread_rwlock_rdlock(&_rwlock); }
+    void unlock_shared() { pthread_rwlock_unlock(&_rwlock); }
+
+   private:
+    pthread_rwlock_t _rwlock;
+};
+
+#define BENCHMARKS_PTHREAD_RWLOCK 1
+
+#endif
+
+#ifdef BENCHMARKS_FUTEX
+
+/**
+ * Spins for up to kMaxSpins tries, then sleeps on a futex until the holder
+ * wakes it. Short waits never reach the kernel, like a spinlock, and long
+ * ones (or waits on a holder that got preempted) don't burn a CPU, like
+ * std::mutex.
+ *
+ * The lock word is 0 when unlocked, 1 when locked, and 2 when locked and
+ * someone may be asleep waiting for it, so that unlock only makes a syscall
+ * when there's someone to wake.
+ */
+template <int kMaxSpins>
+class SpinThenParkMutex {
+   public:
+    void lock() {
+        for (auto spin = 0; spin < kMaxSpins; ++spin) {
+            auto state = _state.load(std::memory_order_relaxed);
+            if (state == kUnlocked &&
+                _state.compare_exchange_weak(state, kLocked,
+                                             std::memory_order_acquire,
+                                             std::memory_order_relaxed)) {
+                return;
+            }
+            cpuRelax();
+        }
+        // Taking it as contended rather than just locked is conservative: if
+        // nobody else is waiting, the next unlock makes one syscall for
+        // nothing.
+        while (_state.exchange(kContended, std::memory_order_acquire) !=
+               kUnlocked) {
+            futexWait(_state, kContended);
+        }
+    }
+
+    void unlock() {
+        if (_state.exchange(kUnlocked, std::memory_order_release) ==
+            kContended) {
+            futexWake(_state, 1);
+        }
+    }
+
+   private:
+    static constexpr std::uint32_t kUnlocked = 0;
+    static constexpr std::uint32_t kLocked = 1;
+    static constexpr std::uint32_t kContended = 2;
+
+    std::atomic<std::uint32_t> _state{kUnlocked};
+};
+
+#endif
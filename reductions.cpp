@@ -0,0 +1,105 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "counters.h"
+#include "reductions.h"
+
+// See reductions.h.
+
+namespace {
+
+template <typename T>
+void runSumWithAccumulators(benchmark::State& state,
+                            T (*sum)(const T*, std::size_t)) {
+    const std::size_t n = state.range(0) / sizeof(T);
+    std::vector<T> arr(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        // Small values so that neither the integer sums overflow nor the
+        // floating point sums lose precision.
+        arr[i] = static_cast<T>(i % 16);
+    }
+
+    BenchmarkCounters counters(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(sum(arr.data(), n));
+    }
+    counters.stop();
+
+    state.SetItemsProcessed(state.iterations() * n);
+    state.SetBytesProcessed(state.iterations() * n * sizeof(T));
+}
+
+void sumWithAccumulatorsArguments(benchmark::internal::Benchmark* b) {
+    // Fits in L1, where the dependency chain is the bottleneck, and fits in
+    // L2, where loads start to matter.
+    b->ArgName("bytes")->Arg(16 << 10)->Arg(256 << 10);
+}
+
+}  // namespace
+
+template <typename T, int kNumAccumulators>
+static void BM_sumWithAccumulators(benchmark::State& state) {
+    runSumWithAccumulators<T>(state, sumWithAccumulators<T, kNumAccumulators>);
+}
+
+template <typename T, int kNumAccumulators>
+static void BM_sumWithAccumulatorsFastMath(benchmark::State& state) {
+    runSumWithAccumulators<T>(state,
+                              sumWithAccumulatorsFastMath<T, kNumAccumulators>);
+}
+
+BENCHMARK_TEMPLATE(BM_sumWithAccumulators, std::int32_t, 1)
+    ->Apply(sumWithAccumulatorsArguments);
+BENCHMARK_TEMPLATE(BM_sumWithAccumulators, std::int32_t, 2)
+    ->Apply(sumWithAccumulatorsArguments);
+BENCHMARK_TEMPLATE(BM_sumWithAccumulators, std::int32_t, 4)
+    ->Apply(sumWithAccumulatorsArguments);
+BENCHMARK_TEMPLATE(BM_sumWithAccumulators, std::int32_t, 8)
+    ->Apply(sumWithAccumulatorsArguments);
+
+BENCHMARK_TEMPLATE(BM_sumWithAccumulators, float, 1)
+    ->Apply(sumWithAccumulatorsArguments);
+BENCHMARK_TEMPLATE(BM_sumWithAccumulators, float, 2)
+    ->Apply(sumWithAccumulatorsArguments);
+BENCHMARK_TEMPLATE(BM_sumWithAccumulators, float, 4)
+    ->Apply(sumWithAccumulatorsArguments);
+BENCHMARK_TEMPLATE(BM_sumWithAccumulators, float, 8)
+    ->Apply(sumWithAccumulatorsArguments);
+
+BENCHMARK_TEMPLATE(BM_sumWithAccumulators, double, 1)
+    ->Apply(sumWithAccumulatorsArguments);
+BENCHMARK_TEMPLATE(BM_sumWithAccumulators, double, 2)
+    ->Apply(sumWithAccumulatorsArguments);
+BENCHMARK_TEMPLATE(BM_sumWithAccumulators, double, 4)
+    ->Apply(sumWithAccumulatorsArguments);
+BENCHMARK_TEMPLATE(BM_sumWithAccumulators, double, 8)
+    ->Apply(sumWithAccumulatorsArguments);
+
+BENCHMARK_TEMPLATE(BM_sumWithAccumulatorsFastMath, std::int32_t, 1)
+    ->Apply(sumWithAccumulatorsArguments);
+BENCHMARK_TEMPLATE(BM_sumWithAccumulatorsFastMath, std::int32_t, 2)
+    ->Apply(sumWithAccumulatorsArguments);
+BENCHMARK_TEMPLATE(BM_sumWithAccumulatorsFastMath, std::int32_t, 4)
+    ->Apply(sumWithAccumulatorsArguments);
+BENCHMARK_TEMPLATE(BM_sumWithAccumulatorsFastMath, std::int32_t, 8)
+    ->Apply(sumWithAccumulatorsArguments);
+
+BENCHMARK_TEMPLATE(BM_sumWithAccumulatorsFastMath, float, 1)
+    ->Apply(sumWithAccumulatorsArguments);
+BENCHMARK_TEMPLATE(BM_sumWithAccumulatorsFastMath, float, 2)
+    ->Apply(sumWithAccumulatorsArguments);
+BENCHMARK_TEMPLATE(BM_sumWithAccumulatorsFastMath, float, 4)
+    ->Apply(sumWithAccumulatorsArguments);
+BENCHMARK_TEMPLATE(BM_sumWithAccumulatorsFastMath, float, 8)
+    ->Apply(sumWithAccumulatorsArguments);
+
+BENCHMARK_TEMPLATE(BM_sumWithAccumulatorsFastMath, double, 1)
+    ->Apply(sumWithAccumulatorsArguments);
+BENCHMARK_TEMPLATE(BM_sumWithAccumulatorsFastMath, double, 2)
+    ->Apply(sumWithAccumulatorsArguments);
+BENCHMARK_TEMPLATE(BM_sumWithAccumulatorsFastMath, double, 4)
+    ->Apply(sumWithAccumulatorsArguments);
+BENCHMARK_TEMPLATE(BM_sumWithAccumulatorsFastMath, double, 8)
+    ->Apply(sumWithAccumulatorsArguments);
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*****************************************************************************
+ * INSTRUCTION-LEVEL PARALLELISM
+ *
+ * Sums an array with 1, 2, 4 or 8 independent accumulators. With a single
+ * accumulator every add depends on the previous one, so the loop runs at one
+ * add per add-latency (about 4 cycles for floating point). With more
+ * accumulators the adds overlap and the loop approaches the throughput limit.
+ *
+ * The compiler can only split the chain itself when it's allowed to
+ * reassociate, which it always is for integers and, for floating point, only
+ * with -ffast-math/-fassociative-math. So the kernel is compiled twice: once
+ * with the default flags (reductions.cpp, which also has the benchmarks) and
+ * once with -ffast-math (reductions_fast_math.cpp).
+ *
+ * This header is all that reductions_fast_math.cpp includes, and it has no
+ * inline functions with external linkage: the linker keeps one copy of
+ * those for the whole program, and could pick the one built with fast-math.
+ *****************************************************************************/
+
+/**
+ * sumWithAccumulators built with -ffast-math, for T in std::int32_t, float
+ * and double and kNumAccumulators in 1, 2, 4 and 8.
+ */
+template <typename T, int kNumAccumulators>
+T sumWithAccumulatorsFastMath(const T* data, std::size_t n);
+
+namespace {
+
+template <typename T, int kNumAccumulators>
+[[gnu::noinline]] T sumWithAccumulators(const T* data, std::size_t n) {
+    T acc[kNumAccumulators] = {};
+    std::size_t i = 0;
+    for (; i + kNumAccumulators <= n; i += kNumAccumulators) {
+        for (auto a = 0; a < kNumAccumulators; ++a) {
+            acc[a] += data[i + a];
+        }
+    }
+
+    T sum = 0;
+    for (auto a = 0; a < kNumAccumulators; ++a) {
+        sum += acc[a];
+    }
+    for (; i < n; ++i) {
+        sum += data[i];
+    }
+    return sum;
+}
+
+}  // namespace
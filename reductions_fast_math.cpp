@@ -0,0 +1,22 @@
+#include "reductions.h"
+
+// See reductions.h. This file is built with -ffast-math, which lets the
+// compiler reassociate the floating point sums (and vectorize them) on its
+// own. Don't include anything else here.
+
+template <typename T, int kNumAccumulators>
+T sumWithAccumulatorsFastMath(const T* data, std::size_t n) {
+    return sumWithAccumulators<T, kNumAccumulators>(data, n);
+}
+
+#define BENCHMARKS_INSTANTIATE_FAST_MATH_SUMS(T)                        \
+    template T sumWithAccumulatorsFastMath<T, 1>(const T*, std::size_t); \
+    template T sumWithAccumulatorsFastMath<T, 2>(const T*, std::size_t); \
+    template T sumWithAccumulatorsFastMath<T, 4>(const T*, std::size_t); \
+    template T sumWithAccumulatorsFastMath<T, 8>(const T*, std::size_t);
+
+BENCHMARKS_INSTANTIATE_FAST_MATH_SUMS(std::int32_t)
+BENCHMARKS_INSTANTIATE_FAST_MATH_SUMS(float)
+BENCHMARKS_INSTANTIATE_FAST_MATH_SUMS(double)
+
+#undef BENCHMARKS_INSTANTIATE_FAST_MATH_SUMS
@@ -0,0 +1,305 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <vector>
+
+#include "counters.h"
+#include "locks.h"
+#include "threads.h"
+
+/*****************************************************************************
+ * READER-WRITER LOCKS
+ *
+ * Threads share a small table (a cache line or two, like a config or a
+ * routing table) that most operations read and a few rewrite, with
+ * writes_per_mille of every 1000 operations being writes. The ways of
+ * sharing it are:
+ *  - std::shared_mutex and pthread_rwlock_t, where every reader writes the
+ *    lock's reader count, so reads from different cores still fight over
+ *    its cache line
+ *  - a seqlock, where readers don't write anything at all: they read a
+ *    sequence number, copy the table and check the sequence number didn't
+ *    change, retrying if a writer got in
+ *  - a big-reader lock: one lock per reader thread on its own cache line,
+ *    so readers only touch their own, and a writer takes all of them
+ *  - RCU-style: readers follow a pointer to an immutable copy, and writers
+ *    publish a new copy and free the old one once every reader that might
+ *    still be looking at it has moved on (epoch-based reclamation)
+ *
+ * Each read checks that it saw the whole of one write, and the benchmark
+ * fails if any read was torn.
+ *****************************************************************************/
+
+namespace {
+
+const int kTableSize = 16;
+
+// Every write sets every entry to the next version, so a consistent read
+// sees them all equal.
+using Table = std::array<std::uint64_t, kTableSize>;
+
+void updateTable(Table& table) {
+    const auto version = table[0] + 1;
+    std::fill(table.begin(), table.end(), version);
+}
+
+bool isConsistent(const Table& table) {
+    return std::all_of(table.begin(), table.end(),
+                       [&](std::uint64_t value) { return value == table[0]; });
+}
+
+/**
+ * The table behind any lock with std::shared_mutex's interface.
+ */
+template <typename RwLock>
+class RwLocked {
+   public:
+    explicit RwLocked(int) {}
+
+    template <typename Read>
+    void read(int, Read&& read) {
+        std::shared_lock lk(_lock);
+        read(_table);
+    }
+
+    void write(int) {
+        std::lock_guard lk(_lock);
+        updateTable(_table);
+    }
+
+   private:
+    RwLock _lock;
+    Table _table{};
+};
+
+class Seqlock {
+   public:
+    explicit Seqlock(int) {}
+
+    template <typename Read>
+    void read(int, Read&& read) {
+        Table copy;
+        while (true) {
+            const auto sequence = _sequence.load(std::memory_order_acquire);
+            if (sequence % 2 == 1) {
+                // A write is in progress.
+                cpuRelax();
+                continue;
+            }
+            for (auto i = 0; i < kTableSize; ++i) {
+                copy[i] = _table[i].load(std::memory_order_relaxed);
+            }
+            // Keeps the reads of the table from moving below the recheck.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (_sequence.load(std::memory_order_relaxed) == sequence) {
+                break;
+            }
+        }
+        read(copy);
+    }
+
+    void write(int) {
+        std::lock_guard lk(_writerLock);
+        const auto sequence = _sequence.load(std::memory_order_relaxed);
+        _sequence.store(sequence + 1, std::memory_order_relaxed);
+        // Keeps the table writes from moving above the odd sequence number.
+        std::atomic_thread_fence(std::memory_order_release);
+        const auto version = _table[0].load(std::memory_order_relaxed) + 1;
+        for (auto& value : _table) {
+            value.store(version, std::memory_order_relaxed);
+        }
+        _sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+   private:
+    alignas(64) std::atomic<std::uint64_t> _sequence{0};
+    // Atomic so that a reader racing with a writer isn't a data race; the
+    // sequence number tells it to throw away what it read.
+    std::array<std::atomic<std::uint64_t>, kTableSize> _table{};
+    TtasLock _writerLock;
+};
+
+class BigReaderLock {
+   public:
+    explicit BigReaderLock(int numThreads) : _readerLocks(numThreads) {}
+
+    template <typename Read>
+    void read(int threadIndex, Read&& read) {
+        std::lock_guard lk(_readerLocks[threadIndex].lock);
+        read(_table);
+    }
+
+    void write(int) {
+        // Always in the same order, so two writers can't deadlock.
+        for (auto& readerLock : _readerLocks) {
+            readerLock.lock.lock();
+        }
+        updateTable(_table);
+        for (auto& readerLock : _readerLocks) {
+            readerLock.lock.unlock();
+        }
+    }
+
+   private:
+    struct alignas(128) ReaderLock {
+        TtasLock lock;
+    };
+
+    std::vector<ReaderLock> _readerLocks;
+    Table _table{};
+};
+
+class EpochRcu {
+   public:
+    explicit EpochRcu(int numThreads)
+        : _readers(numThreads), _current(new Table{}) {}
+
+    ~EpochRcu() {
+        delete _current.load();
+        for (const auto& retired : _retired) {
+            delete retired.table;
+        }
+    }
+
+    EpochRcu(const EpochRcu&) = delete;
+    EpochRcu& operator=(const EpochRcu&) = delete;
+
+    template <typename Read>
+    void read(int threadIndex, Read&& read) {
+        // Announce the epoch before looking at the pointer. Both are seq_cst
+        // so that a writer that doesn't see the announcement is guaranteed
+        // to have published its table before we load the pointer.
+        auto& reader = _readers[threadIndex];
+        reader.epoch.store(_epoch.load());
+        read(*_current.load());
+        reader.epoch.store(kQuiescent, std::memory_order_release);
+    }
+
+    void write(int) {
+        std::lock_guard lk(_writerLock);
+        auto next = new Table(*_current.load(std::memory_order_relaxed));
+        updateTable(*next);
+        auto previous = _current.exchange(next);
+        // Readers that might still have the previous table announced this
+        // epoch or an earlier one.
+        _retired.push_back({previous, _epoch.fetch_add(1)});
+        reclaim();
+    }
+
+   private:
+    static constexpr std::uint64_t kQuiescent = UINT64_MAX;
+
+    struct alignas(128) Reader {
+        std::atomic<std::uint64_t> epoch{kQuiescent};
+    };
+
+    struct Retired {
+        Table* table;
+        std::uint64_t epoch;
+    };
+
+    // Frees every retired table that no reader can still be looking at.
+    void reclaim() {
+        auto oldestReader = kQuiescent;
+        for (const auto& reader : _readers) {
+            oldestReader = std::min<std::uint64_t>(oldestReader,
+                                                   reader.epoch.load());
+        }
+        auto stillInUse = std::remove_if(
+            _retired.begin(), _retired.end(), [&](const Retired& retired) {
+                if (retired.epoch < oldestReader) {
+                    delete retired.table;
+                    return true;
+                }
+                return false;
+            });
+        _retired.erase(stillInUse, _retired.end());
+    }
+
+    std::vector<Reader> _readers;
+    alignas(64) std::atomic<std::uint64_t> _epoch{0};
+    alignas(64) std::atomic<Table*> _current;
+    std::mutex _writerLock;
+    std::vector<Retired> _retired;
+};
+
+// Split between the threads.
+const std::int64_t kNumReadWriteOperations = 1'000'000;
+
+}  // namespace
+
+template <typename Shared>
+static void BM_readWrite(benchmark::State& state) {
+    const int numThreads = state.range(0);
+    const int writesPerMille = state.range(1);
+    const auto operationsPerThread = kNumReadWriteOperations / numThreads;
+
+    // Decide which operations are writes up front so the RNG isn't timed.
+    std::vector<std::vector<bool>> isWrite(numThreads);
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> dist(0, 999);
+    for (auto& pattern : isWrite) {
+        pattern.resize(operationsPerThread);
+        for (std::size_t i = 0; i < pattern.size(); ++i) {
+            pattern[i] = dist(gen) < writesPerMille;
+        }
+    }
+
+    Shared shared(numThreads);
+    std::atomic<std::int64_t> tornReads{0};
+
+    WorkerThreads workers(numThreads);
+    BenchmarkCounters counters(state);
+    for (auto _ : state) {
+        state.SetIterationTime(workers.run([&](int t) {
+            std::int64_t torn = 0;
+            for (std::int64_t i = 0; i < operationsPerThread; ++i) {
+                if (isWrite[t][i]) {
+                    shared.write(t);
+                } else {
+                    shared.read(t, [&](const Table& table) {
+                        torn += !isConsistent(table);
+                    });
+                }
+            }
+            tornReads += torn;
+        }));
+    }
+    counters.stop();
+
+    if (tornReads > 0) {
+        state.SkipWithError("A reader saw a partial write");
+        return;
+    }
+    setThroughputCounters(state, operationsPerThread * numThreads,
+                          numThreads);
+}
+
+static void readWriteArguments(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"threads", "writes_per_mille"});
+    for (auto threads : threadCounts()) {
+        for (auto writesPerMille : {0, 1, 10, 100, 500}) {
+            b->Args({threads, writesPerMille});
+        }
+    }
+}
+
+#define BENCHMARK_READ_WRITE(Shared)         \
+    BENCHMARK_TEMPLATE(BM_readWrite, Shared) \
+        ->Apply(readWriteArguments)          \
+        ->UseManualTime()
+
+BENCHMARK_READ_WRITE(RwLocked<std::shared_mutex>);
+#ifdef BENCHMARKS_PTHREAD_RWLOCK
+BENCHMARK_READ_WRITE(RwLocked<PthreadRwlock>);
+#endif
+BENCHMARK_READ_WRITE(Seqlock);
+BENCHMARK_READ_WRITE(BigReaderLock);
+BENCHMARK_READ_WRITE(EpochRcu);
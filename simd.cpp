@@ -0,0 +1,248 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BENCHMARKS_X86 1
+#endif
+
+#if __has_include(<experimental/simd>)
+#include <experimental/simd>
+#define BENCHMARKS_STD_SIMD 1
+#endif
+
+#include "counters.h"
+
+/*****************************************************************************
+ * SIMD REDUCTIONS
+ *
+ * Sums an array of std::uint32_t the same way the sequential cache benchmarks
+ * do, with: a scalar loop the compiler isn't allowed to vectorize, the plain
+ * loop left to the auto-vectorizer, hand-written SSE2, AVX2 and AVX-512
+ * intrinsics, std::experimental::simd, and whichever of the intrinsic
+ * versions CPUID says is the best one on this machine. Sizes go from one
+ * that fits in L1 to one that only fits in memory.
+ *
+ * The AVX2 and AVX-512 kernels are compiled with target attributes, so the
+ * rest of the binary doesn't need -mavx2 and still runs on older CPUs; their
+ * benchmarks are skipped when the CPU doesn't support them.
+ *****************************************************************************/
+
+using SumKernel = std::uint32_t (*)(const std::uint32_t*, std::size_t);
+
+namespace {
+
+#if defined(__clang__)
+#define BENCHMARKS_NO_VECTORIZE \
+    _Pragma("clang loop vectorize(disable) interleave(disable)")
+#define BENCHMARKS_SCALAR_FUNCTION [[gnu::noinline]]
+#else
+#define BENCHMARKS_NO_VECTORIZE
+#define BENCHMARKS_SCALAR_FUNCTION \
+    [[gnu::noinline, gnu::optimize("no-tree-vectorize")]]
+#endif
+
+BENCHMARKS_SCALAR_FUNCTION std::uint32_t sumScalar(const std::uint32_t* data,
+                                                   std::size_t n) {
+    std::uint32_t sum = 0;
+    BENCHMARKS_NO_VECTORIZE
+    for (std::size_t i = 0; i < n; ++i) {
+        sum += data[i];
+    }
+    return sum;
+}
+
+[[gnu::noinline]] std::uint32_t sumAutoVectorized(const std::uint32_t* data,
+                                                  std::size_t n) {
+    std::uint32_t sum = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        sum += data[i];
+    }
+    return sum;
+}
+
+#ifdef BENCHMARKS_X86
+
+// The hand-written kernels keep four independent vector accumulators so that
+// they're limited by load throughput rather than by the latency of the adds.
+
+std::uint32_t sumSse2(const std::uint32_t* data, std::size_t n) {
+    __m128i acc0 = _mm_setzero_si128();
+    __m128i acc1 = _mm_setzero_si128();
+    __m128i acc2 = _mm_setzero_si128();
+    __m128i acc3 = _mm_setzero_si128();
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        auto p = reinterpret_cast<const __m128i*>(data + i);
+        acc0 = _mm_add_epi32(acc0, _mm_loadu_si128(p));
+        acc1 = _mm_add_epi32(acc1, _mm_loadu_si128(p + 1));
+        acc2 = _mm_add_epi32(acc2, _mm_loadu_si128(p + 2));
+        acc3 = _mm_add_epi32(acc3, _mm_loadu_si128(p + 3));
+    }
+    __m128i acc = _mm_add_epi32(_mm_add_epi32(acc0, acc1),
+                                _mm_add_epi32(acc2, acc3));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    std::uint32_t sum = _mm_cvtsi128_si32(acc);
+    for (; i < n; ++i) {
+        sum += data[i];
+    }
+    return sum;
+}
+
+[[gnu::target("avx2")]] std::uint32_t sumAvx2(const std::uint32_t* data,
+                                              std::size_t n) {
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    __m256i acc2 = _mm256_setzero_si256();
+    __m256i acc3 = _mm256_setzero_si256();
+    std::size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        auto p = reinterpret_cast<const __m256i*>(data + i);
+        acc0 = _mm256_add_epi32(acc0, _mm256_loadu_si256(p));
+        acc1 = _mm256_add_epi32(acc1, _mm256_loadu_si256(p + 1));
+        acc2 = _mm256_add_epi32(acc2, _mm256_loadu_si256(p + 2));
+        acc3 = _mm256_add_epi32(acc3, _mm256_loadu_si256(p + 3));
+    }
+    __m256i acc256 = _mm256_add_epi32(_mm256_add_epi32(acc0, acc1),
+                                      _mm256_add_epi32(acc2, acc3));
+    __m128i acc = _mm_add_epi32(_mm256_castsi256_si128(acc256),
+                                _mm256_extracti128_si256(acc256, 1));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    std::uint32_t sum = _mm_cvtsi128_si32(acc);
+    for (; i < n; ++i) {
+        sum += data[i];
+    }
+    return sum;
+}
+
+[[gnu::target("avx512f")]] std::uint32_t sumAvx512(const std::uint32_t* data,
+                                                   std::size_t n) {
+    __m512i acc0 = _mm512_setzero_si512();
+    __m512i acc1 = _mm512_setzero_si512();
+    __m512i acc2 = _mm512_setzero_si512();
+    __m512i acc3 = _mm512_setzero_si512();
+    std::size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        auto p = data + i;
+        acc0 = _mm512_add_epi32(acc0, _mm512_loadu_si512(p));
+        acc1 = _mm512_add_epi32(acc1, _mm512_loadu_si512(p + 16));
+        acc2 = _mm512_add_epi32(acc2, _mm512_loadu_si512(p + 32));
+        acc3 = _mm512_add_epi32(acc3, _mm512_loadu_si512(p + 48));
+    }
+    std::uint32_t sum = _mm512_reduce_add_epi32(_mm512_add_epi32(
+        _mm512_add_epi32(acc0, acc1), _mm512_add_epi32(acc2, acc3)));
+    for (; i < n; ++i) {
+        sum += data[i];
+    }
+    return sum;
+}
+
+bool hasAvx2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+bool hasAvx512() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f");
+}
+
+#endif
+
+#ifdef BENCHMARKS_STD_SIMD
+
+std::uint32_t sumStdSimd(const std::uint32_t* data, std::size_t n) {
+    namespace stdx = std::experimental;
+    using Vector = stdx::native_simd<std::uint32_t>;
+
+    Vector acc = 0;
+    std::size_t i = 0;
+    for (; i + Vector::size() <= n; i += Vector::size()) {
+        acc += Vector(data + i, stdx::element_aligned);
+    }
+    std::uint32_t sum = stdx::reduce(acc);
+    for (; i < n; ++i) {
+        sum += data[i];
+    }
+    return sum;
+}
+
+#endif
+
+bool alwaysSupported() { return true; }
+
+/**
+ * Picks the widest intrinsic kernel the CPU supports.
+ */
+SumKernel dispatchedSumKernel() {
+#ifdef BENCHMARKS_X86
+    static const SumKernel kernel = hasAvx512() ? sumAvx512
+                                    : hasAvx2() ? sumAvx2
+                                                : sumSse2;
+    return kernel;
+#else
+    return sumAutoVectorized;
+#endif
+}
+
+std::uint32_t sumDispatched(const std::uint32_t* data, std::size_t n) {
+    return dispatchedSumKernel()(data, n);
+}
+
+}  // namespace
+
+static void BM_simdSum(benchmark::State& state, SumKernel kernel,
+                       bool (*isSupported)()) {
+    if (!isSupported()) {
+        state.SkipWithError("Not supported on this CPU");
+        return;
+    }
+
+    const std::size_t n = state.range(0) / sizeof(std::uint32_t);
+    std::vector<std::uint32_t> arr(n);
+    std::iota(arr.begin(), arr.end(), 0);
+
+    if (kernel(arr.data(), n) != sumScalar(arr.data(), n)) {
+        state.SkipWithError("Kernel computed the wrong sum");
+        return;
+    }
+
+    BenchmarkCounters counters(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(kernel(arr.data(), n));
+    }
+    counters.stop();
+
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+static void simdSumArguments(benchmark::internal::Benchmark* b) {
+    // Roughly L1, L2, L3 and main memory sized arrays.
+    b->ArgName("bytes")->RangeMultiplier(16)->Range(16 << 10, 64 << 20);
+}
+
+BENCHMARK_CAPTURE(BM_simdSum, scalar, sumScalar, alwaysSupported)
+    ->Apply(simdSumArguments);
+BENCHMARK_CAPTURE(BM_simdSum, autoVectorized, sumAutoVectorized,
+                  alwaysSupported)
+    ->Apply(simdSumArguments);
+#ifdef BENCHMARKS_X86
+BENCHMARK_CAPTURE(BM_simdSum, sse2, sumSse2, alwaysSupported)
+    ->Apply(simdSumArguments);
+BENCHMARK_CAPTURE(BM_simdSum, avx2, sumAvx2, hasAvx2)->Apply(simdSumArguments);
+BENCHMARK_CAPTURE(BM_simdSum, avx512, sumAvx512, hasAvx512)
+    ->Apply(simdSumArguments);
+#endif
+#ifdef BENCHMARKS_STD_SIMD
+BENCHMARK_CAPTURE(BM_simdSum, stdSimd, sumStdSimd, alwaysSupported)
+    ->Apply(simdSumArguments);
+#endif
+BENCHMARK_CAPTURE(BM_simdSum, dispatched, sumDispatched, alwaysSupported)
+    ->Apply(simdSumArguments);
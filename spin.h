@@ -0,0 +1,45 @@
+#pragma once
+
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/**
+ * Tells the CPU we're in a spin loop: on x86 this is the pause instruction,
+ * which stops the loop from flooding the pipeline with speculative loads and
+ * hands the core to its SMT sibling.
+ */
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+/**
+ * Exponential backoff for spin loops. Each call to pause() spins for twice as
+ * long as the last one, up to kMaxSpins pauses, after which it also yields so
+ * that a waiter doesn't starve the thread it's waiting for when there are
+ * more threads than CPUs.
+ */
+class Backoff {
+   public:
+    void pause() {
+        for (auto i = 0; i < _spins; ++i) {
+            cpuRelax();
+        }
+        if (_spins < kMaxSpins) {
+            _spins *= 2;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+   private:
+    static constexpr int kMaxSpins = 1'024;
+
+    int _spins{1};
+};
@@ -0,0 +1,287 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BENCHMARKS_X86 1
+#endif
+
+#include "cache_info.h"
+#include "counters.h"
+#include "threads.h"
+
+/*****************************************************************************
+ * WRITES
+ *
+ * The cache benchmarks only read. A regular store to a line that isn't in
+ * cache first reads the line from memory (write-allocate), and then evicts
+ * something else to make room for it. Non-temporal ("streaming") stores
+ * skip both: they go through write-combining buffers straight to memory.
+ *
+ * These fill and copy buffers below and above the size of the last level
+ * cache, on one thread and on every hardware thread, with 16-byte regular
+ * stores, 16-byte streaming stores (_mm_stream_si128) and memset/memcpy.
+ * The last benchmark measures what a writer does to a reader on another
+ * core whose data would otherwise stay in the shared cache.
+ *****************************************************************************/
+
+namespace {
+
+using FillKernel = void (*)(char* dst, std::size_t bytes);
+using CopyKernel = void (*)(char* dst, const char* src, std::size_t bytes);
+
+using Buffer = std::unique_ptr<char, decltype(&std::free)>;
+
+Buffer makeBuffer(std::size_t bytes) {
+    Buffer buffer(static_cast<char*>(std::aligned_alloc(64, bytes)),
+                  &std::free);
+    // Fault the pages in so that page faults aren't part of the first
+    // iteration.
+    std::memset(buffer.get(), 1, bytes);
+    return buffer;
+}
+
+void fillMemset(char* dst, std::size_t bytes) { std::memset(dst, 0, bytes); }
+
+void copyMemcpy(char* dst, const char* src, std::size_t bytes) {
+    std::memcpy(dst, src, bytes);
+}
+
+#ifdef BENCHMARKS_X86
+
+// Buffers and chunks are 64-byte aligned multiples of 64 bytes, so these
+// don't need to handle the ends.
+
+void fillStores(char* dst, std::size_t bytes) {
+    const __m128i value = _mm_setzero_si128();
+    for (auto p = reinterpret_cast<__m128i*>(dst),
+              end = reinterpret_cast<__m128i*>(dst + bytes);
+         p < end; p += 4) {
+        _mm_store_si128(p, value);
+        _mm_store_si128(p + 1, value);
+        _mm_store_si128(p + 2, value);
+        _mm_store_si128(p + 3, value);
+    }
+}
+
+void fillStream(char* dst, std::size_t bytes) {
+    const __m128i value = _mm_setzero_si128();
+    for (auto p = reinterpret_cast<__m128i*>(dst),
+              end = reinterpret_cast<__m128i*>(dst + bytes);
+         p < end; p += 4) {
+        _mm_stream_si128(p, value);
+        _mm_stream_si128(p + 1, value);
+        _mm_stream_si128(p + 2, value);
+        _mm_stream_si128(p + 3, value);
+    }
+    // Streaming stores are weakly ordered; make them visible before anyone
+    // reads the buffer.
+    _mm_sfence();
+}
+
+void copyStores(char* dst, const char* src, std::size_t bytes) {
+    auto in = reinterpret_cast<const __m128i*>(src);
+    for (auto p = reinterpret_cast<__m128i*>(dst),
+              end = reinterpret_cast<__m128i*>(dst + bytes);
+         p < end; p += 4, in += 4) {
+        _mm_store_si128(p, _mm_load_si128(in));
+        _mm_store_si128(p + 1, _mm_load_si128(in + 1));
+        _mm_store_si128(p + 2, _mm_load_si128(in + 2));
+        _mm_store_si128(p + 3, _mm_load_si128(in + 3));
+    }
+}
+
+void copyStream(char* dst, const char* src, std::size_t bytes) {
+    auto in = reinterpret_cast<const __m128i*>(src);
+    for (auto p = reinterpret_cast<__m128i*>(dst),
+              end = reinterpret_cast<__m128i*>(dst + bytes);
+         p < end; p += 4, in += 4) {
+        _mm_stream_si128(p, _mm_load_si128(in));
+        _mm_stream_si128(p + 1, _mm_load_si128(in + 1));
+        _mm_stream_si128(p + 2, _mm_load_si128(in + 2));
+        _mm_stream_si128(p + 3, _mm_load_si128(in + 3));
+    }
+    _mm_sfence();
+}
+
+#endif
+
+/**
+ * Each thread's share of a buffer, rounded down to whole cache lines.
+ */
+std::size_t chunkSize(std::size_t bytes, int numThreads) {
+    return bytes / numThreads / 64 * 64;
+}
+
+}  // namespace
+
+static void BM_fill(benchmark::State& state, FillKernel kernel) {
+    const std::size_t bytes = state.range(0);
+    const int numThreads = state.range(1);
+    const auto chunk = chunkSize(bytes, numThreads);
+    auto dst = makeBuffer(bytes);
+
+    WorkerThreads workers(numThreads);
+    BenchmarkCounters counters(state);
+    for (auto _ : state) {
+        state.SetIterationTime(workers.run(
+            [&](int t) { kernel(dst.get() + t * chunk, chunk); }));
+    }
+    counters.stop();
+
+    state.SetBytesProcessed(state.iterations() * chunk * numThreads);
+}
+
+static void BM_copy(benchmark::State& state, CopyKernel kernel) {
+    const std::size_t bytes = state.range(0);
+    const int numThreads = state.range(1);
+    const auto chunk = chunkSize(bytes, numThreads);
+    auto src = makeBuffer(bytes);
+    auto dst = makeBuffer(bytes);
+
+    WorkerThreads workers(numThreads);
+    BenchmarkCounters counters(state);
+    for (auto _ : state) {
+        state.SetIterationTime(workers.run([&](int t) {
+            kernel(dst.get() + t * chunk, src.get() + t * chunk, chunk);
+        }));
+    }
+    counters.stop();
+
+    // Bytes copied; the memory traffic is at least twice this.
+    state.SetBytesProcessed(state.iterations() * chunk * numThreads);
+}
+
+/**
+ * Times a reader summing a buffer that fits in the last level cache while
+ * another thread keeps writing a buffer that doesn't. With regular stores the
+ * writer's lines push the reader's out of the shared cache; with streaming
+ * stores they shouldn't.
+ *
+ * Whether the two share a last level cache at all depends on where they run,
+ * so this runs unpinned and in each placement (see topology.h). Without a
+ * writer the reader alone is pinned to the first CPU of the pair.
+ */
+static void BM_readWhileWriting(benchmark::State& state, FillKernel writer) {
+    const auto cpus = benchmarkPlacementCpus(state, 0);
+    if (state.error_occurred()) {
+        return;
+    }
+    const auto readBytes = lastLevelCacheSize() / 4;
+    const auto writeBytes = std::min<std::size_t>(lastLevelCacheSize() * 4,
+                                                  std::size_t{1} << 30);
+    const auto numPasses = 8;
+    auto readBuffer = makeBuffer(readBytes);
+    auto writeBuffer = makeBuffer(writeBytes);
+
+    auto read = [&] {
+        auto data = reinterpret_cast<const std::uint64_t*>(readBuffer.get());
+        std::uint64_t sum = 0;
+        for (std::size_t i = 0; i < readBytes / sizeof(std::uint64_t); ++i) {
+            sum += data[i];
+        }
+        benchmark::DoNotOptimize(sum);
+    };
+
+    // Thread 0 reads, and thread 1, if there's a writer, writes until the
+    // reader is done.
+    WorkerThreads workers(writer ? 2 : 1, cpus);
+    BenchmarkCounters counters(state);
+    for (auto _ : state) {
+        std::atomic<bool> done{false};
+        double readSeconds = 0;
+        workers.run([&](int t) {
+            if (t == 1) {
+                while (!done) {
+                    writer(writeBuffer.get(), writeBytes);
+                }
+                return;
+            }
+
+            // Warm up the reader's buffer.
+            read();
+            auto start = std::chrono::high_resolution_clock::now();
+            for (auto pass = 0; pass < numPasses; ++pass) {
+                read();
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            done = true;
+
+            readSeconds =
+                std::chrono::duration_cast<std::chrono::duration<double>>(
+                    end - start)
+                    .count();
+        });
+
+        state.SetIterationTime(readSeconds);
+    }
+    counters.stop();
+
+    state.SetBytesProcessed(state.iterations() * numPasses * readBytes);
+}
+
+static void storeArguments(benchmark::internal::Benchmark* b) {
+    const auto llc = lastLevelCacheSize();
+    const int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    b->ArgNames({"bytes", "threads"});
+    // Comfortably inside and well outside the last level cache.
+    for (std::size_t bytes :
+         {llc / 8, std::min<std::size_t>(llc * 4, std::size_t{1} << 30)}) {
+        b->Args({static_cast<std::int64_t>(bytes), 1});
+        if (maxThreads > 1) {
+            b->Args({static_cast<std::int64_t>(bytes), maxThreads});
+        }
+    }
+}
+
+BENCHMARK_CAPTURE(BM_fill, memset, fillMemset)
+    ->Apply(storeArguments)
+    ->UseManualTime();
+BENCHMARK_CAPTURE(BM_copy, memcpy, copyMemcpy)
+    ->Apply(storeArguments)
+    ->UseManualTime();
+#ifdef BENCHMARKS_X86
+BENCHMARK_CAPTURE(BM_fill, stores, fillStores)
+    ->Apply(storeArguments)
+    ->UseManualTime();
+BENCHMARK_CAPTURE(BM_fill, stream, fillStream)
+    ->Apply(storeArguments)
+    ->UseManualTime();
+BENCHMARK_CAPTURE(BM_copy, stores, copyStores)
+    ->Apply(storeArguments)
+    ->UseManualTime();
+BENCHMARK_CAPTURE(BM_copy, stream, copyStream)
+    ->Apply(storeArguments)
+    ->UseManualTime();
+#endif
+
+static void readWhileWritingArguments(benchmark::internal::Benchmark* b) {
+    b->ArgName("placement");
+    for (auto placement : kPlacements) {
+        b->Arg(static_cast<int>(placement));
+    }
+}
+
+BENCHMARK_CAPTURE(BM_readWhileWriting, alone, nullptr)
+    ->Apply(readWhileWritingArguments)
+    ->UseManualTime();
+BENCHMARK_CAPTURE(BM_readWhileWriting, memset, fillMemset)
+    ->Apply(readWhileWritingArguments)
+    ->UseManualTime();
+#ifdef BENCHMARKS_X86
+BENCHMARK_CAPTURE(BM_readWhileWriting, stores, fillStores)
+    ->Apply(readWhileWritingArguments)
+    ->UseManualTime();
+BENCHMARK_CAPTURE(BM_readWhileWriting, stream, fillStream)
+    ->Apply(readWhileWritingArguments)
+    ->UseManualTime();
+#endif
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "barrier.h"
+#include "topology.h"
+
+/**
+ * Threads that stay alive for a whole benchmark, so that its iterations don't
+ * pay for creating, waking up and joining threads. Each call to run() starts
+ * a round on every thread with a reusable barrier, and is timed by the
+ * threads themselves, from when the first one starts until the last one
+ * finishes. Meant for benchmarks that use manual time:
+ *
+ *     WorkerThreads workers(numThreads);
+ *     BenchmarkCounters counters(state);
+ *     for (auto _ : state) {
+ *         state.SetIterationTime(workers.run([&](int t) { ... }));
+ *     }
+ *     counters.stop();
+ *
+ * Construct it before BenchmarkCounters so that starting the threads isn't
+ * counted. The hardware counters count every thread, including the one that
+ * calls run(), so that one sleeps until the round is over rather than
+ * spinning, which would add its cycles and instructions to the workers'.
+ *
+ * If cpus isn't empty, thread t is pinned to cpus[t].
+ */
+class WorkerThreads {
+   public:
+    explicit WorkerThreads(int numThreads, const std::vector<int>& cpus = {})
+        : _start(numThreads + 1), _timestamps(numThreads) {
+        for (auto t = 0; t < numThreads; ++t) {
+            const int cpu =
+                static_cast<std::size_t>(t) < cpus.size() ? cpus[t] : -1;
+            _threads.emplace_back([this, t, cpu] {
+                if (cpu >= 0) {
+                    pinThisThread(cpu);
+                }
+                work(t);
+            });
+        }
+    }
+
+    ~WorkerThreads() {
+        _stop = true;
+        _start.arriveAndWait();
+        for (auto& thread : _threads) {
+            thread.join();
+        }
+    }
+
+    WorkerThreads(const WorkerThreads&) = delete;
+    WorkerThreads& operator=(const WorkerThreads&) = delete;
+
+    /**
+     * Runs body(threadIndex) once on every thread and returns the time in
+     * seconds from when the first thread started it until the last one
+     * finished.
+     */
+    template <typename Body>
+    double run(Body&& body) {
+        // Type-erased by hand so that a round doesn't allocate.
+        _body = [](void* context, int t) {
+            (*static_cast<std::remove_reference_t<Body>*>(context))(t);
+        };
+        _context = const_cast<void*>(static_cast<const void*>(&body));
+
+        _running = static_cast<int>(_threads.size());
+        _start.arriveAndWait();
+        {
+            std::unique_lock lk(_doneMutex);
+            _doneCv.wait(lk, [this] { return _running == 0; });
+        }
+
+        auto first = _timestamps.front().start;
+        auto last = _timestamps.front().end;
+        for (const auto& timestamps : _timestamps) {
+            first = std::min(first, timestamps.start);
+            last = std::max(last, timestamps.end);
+        }
+        return std::chrono::duration_cast<std::chrono::duration<double>>(
+                   last - first)
+            .count();
+    }
+
+   private:
+    using Clock = std::chrono::high_resolution_clock;
+
+    // Padded so that threads writing their own don't share cache lines.
+    struct alignas(128) Timestamps {
+        Clock::time_point start;
+        Clock::time_point end;
+    };
+
+    void work(int t) {
+        while (true) {
+            _start.arriveAndWait();
+            if (_stop) {
+                return;
+            }
+            _timestamps[t].start = Clock::now();
+            _body(_context, t);
+            _timestamps[t].end = Clock::now();
+
+            std::lock_guard lk(_doneMutex);
+            if (--_running == 0) {
+                _doneCv.notify_one();
+            }
+        }
+    }
+
+    // Not Barrier, which spins flat out: threads waiting for the next round
+    // would take CPU time from the ones still running this one whenever there
+    // are more threads than CPUs.
+    BackoffBarrier _start;
+    // How many threads are still running this round.
+    std::mutex _doneMutex;
+    std::condition_variable _doneCv;
+    int _running = 0;
+    std::vector<Timestamps> _timestamps;
+    std::vector<std::thread> _threads;
+    void (*_body)(void*, int) = nullptr;
+    void* _context = nullptr;
+    bool _stop = false;
+};
+
+/**
+ * Thread counts from minThreads to the number of hardware threads, doubling
+ * each time, and always including the hardware thread count itself, rounded
+ * down to a multiple of step.
+ */
+inline std::vector<int> threadCounts(int minThreads = 1, int step = 1) {
+    const int maxThreads = std::max<int>(
+        minThreads, std::thread::hardware_concurrency() / step * step);
+    std::vector<int> counts;
+    for (auto threads = minThreads; threads < maxThreads; threads *= 2) {
+        counts.push_back(threads);
+    }
+    counts.push_back(maxThreads);
+    return counts;
+}
+
+/**
+ * The CPUs to pin a benchmark's threads to for the placement in argument
+ * `arg`, or none if it runs unpinned. Labels the benchmark with the
+ * placement, and skips it if this machine has no CPUs placed that way.
+ */
+inline std::vector<int> benchmarkPlacementCpus(benchmark::State& state,
+                                               int arg) {
+    const auto placement = static_cast<Placement>(state.range(arg));
+    state.SetLabel(placementName(placement));
+    auto cpus = placementCpus(placement);
+    if (placement != Placement::kUnpinned && cpus.empty()) {
+        state.SkipWithError("No CPUs with this placement on this machine");
+    }
+    return cpus;
+}
+
+/**
+ * Calls add(threads, placement) for every unpinned thread count, and for two
+ * threads in each pinned placement.
+ */
+template <typename Add>
+void forEachThreadPlacement(Add add) {
+    for (auto placement : kPlacements) {
+        if (placement == Placement::kUnpinned) {
+            for (auto threads : threadCounts()) {
+                add(threads, static_cast<int>(placement));
+            }
+        } else {
+            add(2, static_cast<int>(placement));
+        }
+    }
+}
+
+/**
+ * Reports ops_per_second for all the threads together, and
+ * ops_per_second_per_thread, given how many operations all the threads do in
+ * one iteration. With manual time these are rates over the manual time.
+ */
+inline void setThroughputCounters(benchmark::State& state,
+                                  double opsPerIteration, int numThreads) {
+    state.counters["ops_per_second"] = benchmark::Counter(
+        opsPerIteration, benchmark::Counter::kIsIterationInvariantRate);
+    state.counters["ops_per_second_per_thread"] =
+        benchmark::Counter(opsPerIteration / numThreads,
+                           benchmark::Counter::kIsIterationInvariantRate);
+}
@@ -0,0 +1,231 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "counters.h"
+
+/*****************************************************************************
+ * LOOP TILING
+ *
+ * The column order traversals in the cache benchmarks show what happens when
+ * the access pattern walks across cache lines instead of along them. These
+ * show the usual fixes: splitting the matrix into tiles small enough that
+ * the lines a tile touches stay in cache until every element in them has
+ * been used, either with an explicit tile size or recursively, so that some
+ * level of the recursion fits each level of the cache without knowing its
+ * size.
+ *
+ * Matrices are n x n std::uint32_t, stored row-major, like the cache
+ * benchmarks. Arguments are the matrix size and, for the tiled versions, the
+ * tile size.
+ *****************************************************************************/
+
+namespace {
+
+using Matrix = std::vector<std::uint32_t>;
+
+Matrix makeMatrix(std::size_t n) {
+    Matrix m(n * n);
+    for (std::size_t i = 0; i < n; ++i) {
+        for (std::size_t j = 0; j < n; ++j) {
+            m[i * n + j] = i * j;
+        }
+    }
+    return m;
+}
+
+// Below this many elements on a side the recursive transpose stops
+// splitting. 16 x 16 std::uint32_ts is 16 cache lines in each matrix.
+const std::size_t kRecursiveTransposeBaseCase = 16;
+
+void transposeRecursive(const std::uint32_t* src, std::uint32_t* dst,
+                        std::size_t n, std::size_t rowBegin,
+                        std::size_t rowEnd, std::size_t colBegin,
+                        std::size_t colEnd) {
+    const auto rows = rowEnd - rowBegin;
+    const auto cols = colEnd - colBegin;
+    if (rows <= kRecursiveTransposeBaseCase &&
+        cols <= kRecursiveTransposeBaseCase) {
+        for (auto i = rowBegin; i < rowEnd; ++i) {
+            for (auto j = colBegin; j < colEnd; ++j) {
+                dst[j * n + i] = src[i * n + j];
+            }
+        }
+    } else if (rows >= cols) {
+        const auto mid = rowBegin + rows / 2;
+        transposeRecursive(src, dst, n, rowBegin, mid, colBegin, colEnd);
+        transposeRecursive(src, dst, n, mid, rowEnd, colBegin, colEnd);
+    } else {
+        const auto mid = colBegin + cols / 2;
+        transposeRecursive(src, dst, n, rowBegin, rowEnd, colBegin, mid);
+        transposeRecursive(src, dst, n, rowBegin, rowEnd, mid, colEnd);
+    }
+}
+
+}  // namespace
+
+static void BM_rowTraversal(benchmark::State& state) {
+    const std::size_t n = state.range(0);
+    auto m = makeMatrix(n);
+
+    BenchmarkCounters counters(state);
+    for (auto _ : state) {
+        std::uint32_t sum = 0;
+        for (std::size_t i = 0; i < n; ++i) {
+            for (std::size_t j = 0; j < n; ++j) {
+                sum += m[i * n + j];
+            }
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    counters.stop();
+
+    state.SetBytesProcessed(state.iterations() * n * n *
+                            sizeof(std::uint32_t));
+}
+
+static void BM_columnTraversal(benchmark::State& state) {
+    const std::size_t n = state.range(0);
+    auto m = makeMatrix(n);
+
+    BenchmarkCounters counters(state);
+    for (auto _ : state) {
+        std::uint32_t sum = 0;
+        for (std::size_t j = 0; j < n; ++j) {
+            for (std::size_t i = 0; i < n; ++i) {
+                sum += m[i * n + j];
+            }
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    counters.stop();
+
+    state.SetBytesProcessed(state.iterations() * n * n *
+                            sizeof(std::uint32_t));
+}
+
+/**
+ * Column order traversal, but one strip of `tile` columns at a time, so that
+ * the cache lines loaded for one column are still there for the next.
+ */
+static void BM_columnTraversalTiled(benchmark::State& state) {
+    const std::size_t n = state.range(0);
+    const std::size_t tile = state.range(1);
+    auto m = makeMatrix(n);
+
+    BenchmarkCounters counters(state);
+    for (auto _ : state) {
+        std::uint32_t sum = 0;
+        for (std::size_t jj = 0; jj < n; jj += tile) {
+            const auto jEnd = std::min(jj + tile, n);
+            for (std::size_t ii = 0; ii < n; ii += tile) {
+                const auto iEnd = std::min(ii + tile, n);
+                for (auto j = jj; j < jEnd; ++j) {
+                    for (auto i = ii; i < iEnd; ++i) {
+                        sum += m[i * n + j];
+                    }
+                }
+            }
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    counters.stop();
+
+    state.SetBytesProcessed(state.iterations() * n * n *
+                            sizeof(std::uint32_t));
+}
+
+/**
+ * Reads the source in row order and writes the destination in column order,
+ * so every write lands on a different cache line.
+ */
+static void BM_transposeNaive(benchmark::State& state) {
+    const std::size_t n = state.range(0);
+    auto src = makeMatrix(n);
+    Matrix dst(n * n);
+
+    BenchmarkCounters counters(state);
+    for (auto _ : state) {
+        for (std::size_t i = 0; i < n; ++i) {
+            for (std::size_t j = 0; j < n; ++j) {
+                dst[j * n + i] = src[i * n + j];
+            }
+        }
+        benchmark::ClobberMemory();
+    }
+    counters.stop();
+
+    // Every element is read once and written once.
+    state.SetBytesProcessed(state.iterations() * 2 * n * n *
+                            sizeof(std::uint32_t));
+}
+
+static void BM_transposeTiled(benchmark::State& state) {
+    const std::size_t n = state.range(0);
+    const std::size_t tile = state.range(1);
+    auto src = makeMatrix(n);
+    Matrix dst(n * n);
+
+    BenchmarkCounters counters(state);
+    for (auto _ : state) {
+        for (std::size_t ii = 0; ii < n; ii += tile) {
+            const auto iEnd = std::min(ii + tile, n);
+            for (std::size_t jj = 0; jj < n; jj += tile) {
+                const auto jEnd = std::min(jj + tile, n);
+                for (auto i = ii; i < iEnd; ++i) {
+                    for (auto j = jj; j < jEnd; ++j) {
+                        dst[j * n + i] = src[i * n + j];
+                    }
+                }
+            }
+        }
+        benchmark::ClobberMemory();
+    }
+    counters.stop();
+
+    state.SetBytesProcessed(state.iterations() * 2 * n * n *
+                            sizeof(std::uint32_t));
+}
+
+/**
+ * Cache-oblivious transpose: recursively halves the longer side until the
+ * block is small, without being told anything about the cache.
+ */
+static void BM_transposeRecursive(benchmark::State& state) {
+    const std::size_t n = state.range(0);
+    auto src = makeMatrix(n);
+    Matrix dst(n * n);
+
+    BenchmarkCounters counters(state);
+    for (auto _ : state) {
+        transposeRecursive(src.data(), dst.data(), n, 0, n, 0, n);
+        benchmark::ClobberMemory();
+    }
+    counters.stop();
+
+    state.SetBytesProcessed(state.iterations() * 2 * n * n *
+                            sizeof(std::uint32_t));
+}
+
+static void matrixSizeArguments(benchmark::internal::Benchmark* b) {
+    b->ArgName("n")->Arg(1'024)->Arg(2'048)->Arg(4'096);
+}
+
+static void tiledArguments(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"n", "tile"});
+    for (auto n : {1'024, 2'048, 4'096}) {
+        for (auto tile = 4; tile <= 256; tile *= 2) {
+            b->Args({n, tile});
+        }
+    }
+}
+
+BENCHMARK(BM_rowTraversal)->Apply(matrixSizeArguments);
+BENCHMARK(BM_columnTraversal)->Apply(matrixSizeArguments);
+BENCHMARK(BM_columnTraversalTiled)->Apply(tiledArguments);
+
+BENCHMARK(BM_transposeNaive)->Apply(matrixSizeArguments);
+BENCHMARK(BM_transposeTiled)->Apply(tiledArguments);
+BENCHMARK(BM_transposeRecursive)->Apply(matrixSizeArguments);
@@ -0,0 +1,134 @@
+#include "topology.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+#if defined(__linux__)
+
+// Reads the first integer in a sysfs file, which is also the lowest CPU in a
+// CPU list like "0-3,8-11".
+int readInt(const std::filesystem::path& path, int fallback) {
+    std::ifstream file(path);
+    int value;
+    return file >> value ? value : fallback;
+}
+
+CpuLocation readCpuLocation(int cpu) {
+    const std::filesystem::path dir =
+        "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+
+    CpuLocation location{cpu, -1, -1, -1, -1};
+    location.core = readInt(dir / "topology/core_id", -1);
+    location.package = readInt(dir / "topology/physical_package_id", -1);
+
+    std::error_code ec;
+    for (const auto& entry :
+         std::filesystem::directory_iterator(dir / "cache", ec)) {
+        if (readInt(entry.path() / "level", 0) == 3) {
+            location.l3 = readInt(entry.path() / "shared_cpu_list", -1);
+        }
+    }
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        const auto name = entry.path().filename().string();
+        if (name.rfind("node", 0) == 0 && name.size() > 4) {
+            location.node = std::stoi(name.substr(4));
+        }
+    }
+    return location;
+}
+
+std::vector<CpuLocation> readCpuTopology() {
+    std::vector<CpuLocation> topology;
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return topology;
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &allowed)) {
+            topology.push_back(readCpuLocation(cpu));
+        }
+    }
+    // Without core ids we can't tell anything apart.
+    if (!topology.empty() && topology.front().core < 0) {
+        topology.clear();
+    }
+    return topology;
+}
+
+#endif
+
+bool sameCore(const CpuLocation& a, const CpuLocation& b) {
+    return a.package == b.package && a.core == b.core;
+}
+
+bool matchesPlacement(const CpuLocation& a, const CpuLocation& b,
+                      Placement placement) {
+    switch (placement) {
+        case Placement::kSmtSiblings:
+            return sameCore(a, b);
+        case Placement::kSameL3:
+            return a.l3 >= 0 && a.l3 == b.l3 && !sameCore(a, b);
+        case Placement::kCrossSocket:
+            return a.package != b.package ||
+                   (a.node >= 0 && b.node >= 0 && a.node != b.node);
+        case Placement::kUnpinned:
+            break;
+    }
+    return false;
+}
+
+}  // namespace
+
+const std::vector<CpuLocation>& cpuTopology() {
+#if defined(__linux__)
+    static const std::vector<CpuLocation> topology = readCpuTopology();
+#else
+    static const std::vector<CpuLocation> topology;
+#endif
+    return topology;
+}
+
+const char* placementName(Placement placement) {
+    switch (placement) {
+        case Placement::kUnpinned:
+            return "unpinned";
+        case Placement::kSmtSiblings:
+            return "smt_siblings";
+        case Placement::kSameL3:
+            return "same_l3";
+        case Placement::kCrossSocket:
+            return "cross_socket";
+    }
+    return "unknown";
+}
+
+std::vector<int> placementCpus(Placement placement) {
+    const auto& topology = cpuTopology();
+    for (std::size_t i = 0; i < topology.size(); ++i) {
+        for (std::size_t j = i + 1; j < topology.size(); ++j) {
+            if (matchesPlacement(topology[i], topology[j], placement)) {
+                return {topology[i].cpu, topology[j].cpu};
+            }
+        }
+    }
+    return {};
+}
+
+void pinThisThread(int cpu) {
+#if defined(__linux__)
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#else
+    (void)cpu;
+#endif
+}
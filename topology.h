@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+
+/**
+ * Where one logical CPU sits in the machine.
+ */
+struct CpuLocation {
+    int cpu;
+    // core_id, which is only unique within a package.
+    int core;
+    int package;
+    // Lowest numbered CPU sharing this CPU's L3, or -1 if it has none.
+    int l3;
+    // NUMA node, or -1 if the kernel doesn't say.
+    int node;
+};
+
+/**
+ * The CPUs this process is allowed to run on, read from
+ * /sys/devices/system/cpu/cpu*. Empty if the topology can't be read, which
+ * is always the case outside of Linux.
+ */
+const std::vector<CpuLocation>& cpuTopology();
+
+/**
+ * How the threads of a two-thread benchmark are placed relative to each
+ * other.
+ */
+enum class Placement {
+    // Wherever the scheduler puts them.
+    kUnpinned,
+    // Two hardware threads of the same core.
+    kSmtSiblings,
+    // Two different cores sharing an L3.
+    kSameL3,
+    // Two different sockets, or NUMA nodes when there's only one socket.
+    kCrossSocket,
+};
+
+const std::vector<Placement> kPlacements = {
+    Placement::kUnpinned, Placement::kSmtSiblings, Placement::kSameL3,
+    Placement::kCrossSocket};
+
+const char* placementName(Placement placement);
+
+/**
+ * Two CPUs that are placed relative to each other as asked, or an empty
+ * vector if this machine doesn't have any (and for Placement::kUnpinned).
+ */
+std::vector<int> placementCpus(Placement placement);
+
+/**
+ * Pins the calling thread to one CPU. Does nothing if it can't.
+ */
+void pinThisThread(int cpu);